@@ -3,11 +3,24 @@
  */
 
 #include <stdio.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 #include "SDL.h"
 
@@ -24,6 +37,25 @@
 #define BUILTIN_SPRITES_OFFSET 0x100
 #define RAM_SIZE 0x1000
 #define INSTRUCTION_LENGTH 2
+#define CYCLES_PER_FRAME 8
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+
+#define FRAME_NS (1000000000ULL / 60)
+#define HISTOGRAM_SUB_BUCKETS 8
+#define HISTOGRAM_BUCKETS ((64 - 2) * HISTOGRAM_SUB_BUCKETS)
+#define CAPTURE_QUEUE 2048
+#define FUZZ_FRAMES 8
+#define FUZZ_CYCLES 1000
+
+#define BLOCK_CALL 0x1
+#define BLOCK_RETURN 0x2
+#define BLOCK_HALT 0x4
+#define BLOCK_WRITES 0x8
+#define BLOCK_DYNAMIC 0x10
+
+#define CACHE_MAGIC "C8AC"
+#define CACHE_VERSION 1 /** Bump when the analysis or decoding changes */
 
 #define NELEMS(x) (sizeof(x) / sizeof((x)[0]))
 #define STRING_LEN_COUNT(s) #s, 1, NELEMS(#s) - 1
@@ -48,6 +80,79 @@ typedef uint8_t c8_register_t;
  */
 typedef uint8_t * RAM_t;
 
+/**
+ * A captured frame.
+ */
+typedef struct {
+	/**
+	 * The display pixels.
+	 */
+	uint64_t p[DISPLAY_H];
+
+	/**
+	 * The emulated frame it was captured at.
+	 */
+	uint64_t frame;
+} Capture_Frame_t;
+
+/**
+ * A video capture.
+ *
+ * The emulator pushes frames into a single-producer single-consumer ring,
+ * a writer thread encodes them.
+ */
+typedef struct {
+	/**
+	 * The ring of frames.
+	 */
+	Capture_Frame_t frames[CAPTURE_QUEUE];
+
+	/**
+	 * Frames pushed, only written by the emulator.
+	 */
+	atomic_uint_fast64_t head;
+
+	/**
+	 * Frames encoded, only written by the writer.
+	 */
+	atomic_uint_fast64_t tail;
+
+	/**
+	 * No more frames are coming.
+	 */
+	atomic_bool done;
+
+	/**
+	 * The emulated frame the capture ended at, set before done.
+	 */
+	uint64_t end;
+
+	/**
+	 * Frames dropped because the writer fell behind.
+	 */
+	uint64_t dropped;
+
+	/**
+	 * The output file.
+	 */
+	FILE *out;
+
+	/**
+	 * Animated GIF, otherwise Y4M.
+	 */
+	bool gif;
+
+	/**
+	 * Output pixels per display pixel.
+	 */
+	int scale;
+
+	/**
+	 * The writer thread.
+	 */
+	pthread_t writer;
+} Capture_t;
+
 /**
  * The display.
  */
@@ -61,6 +166,11 @@ typedef struct {
 	 * An SDL renderer.
 	 */
 	SDL_Renderer *renderer;
+
+	/**
+	 * A video capture, if recording.
+	 */
+	Capture_t *capture;
 } Display_t;
 
 /**
@@ -68,6 +178,16 @@ typedef struct {
  */
 typedef struct {
 	uint8_t HALT : 1;
+
+	/**
+	 * Running ahead, to be rolled back.
+	 */
+	uint8_t SPECULATIVE : 1;
+
+	/**
+	 * Don't beep.
+	 */
+	uint8_t MUTE : 1;
 } CPU_Flags_t;
 
 /**
@@ -104,6 +224,12 @@ typedef struct {
 	 */
 	RAM_t ram;
 
+	/**
+	 * Instructions decoded ahead of time by address, 0 where they have to
+	 * be fetched, if any.
+	 */
+	const c8_instruction_t *decoded;
+
 	/**
 	 * A pointer to the display.
 	 */
@@ -128,8 +254,256 @@ typedef struct {
 	 * Sound timer.
 	 */
 	uint8_t sound;
+
+	/**
+	 * Instructions executed.
+	 */
+	uint64_t cycles;
+
+	/**
+	 * Random number generator state.
+	 */
+	unsigned int seed;
+
+	/**
+	 * Why the CPU halted, if it did.
+	 */
+	const char *fault;
+
+	/**
+	 * The instruction that faulted, if any.
+	 */
+	c8_instruction_t fault_instruction;
 } CPU_t;
 
+/**
+ * The debugger.
+ */
+typedef struct {
+	/**
+	 * Whether any breakpoint or watchpoint is set or we're stepping.
+	 */
+	bool armed;
+
+	/**
+	 * Stop before the next instruction.
+	 */
+	bool paused;
+
+	/**
+	 * A RAM_SIZE bitmap of PC breakpoints.
+	 */
+	uint64_t breakpoints[RAM_SIZE / 64];
+
+	/**
+	 * A RAM_SIZE bitmap of read watchpoints.
+	 */
+	uint64_t watch_read[RAM_SIZE / 64];
+
+	/**
+	 * A RAM_SIZE bitmap of write watchpoints.
+	 */
+	uint64_t watch_write[RAM_SIZE / 64];
+} Debugger_t;
+
+/**
+ * The one and only debugger.
+ */
+Debugger_t debugger;
+
+/**
+ * Set a bit in a RAM_SIZE bitmap.
+ *
+ * \param bitmap The bitmap.
+ * \param address The address to set.
+ *
+ * \return void
+ */
+void bitmap_set(uint64_t *bitmap, c8_address_t address) {
+	bitmap[address / 64] |= 1ULL << (address % 64);
+}
+
+/**
+ * Clear a bit in a RAM_SIZE bitmap.
+ *
+ * \param bitmap The bitmap.
+ * \param address The address to clear.
+ *
+ * \return void
+ */
+void bitmap_clear(uint64_t *bitmap, c8_address_t address) {
+	bitmap[address / 64] &= ~(1ULL << (address % 64));
+}
+
+/**
+ * Test a bit in a RAM_SIZE bitmap.
+ *
+ * \param bitmap The bitmap.
+ * \param address The address to test.
+ *
+ * \return bool Whether the bit is set.
+ */
+bool bitmap_test(const uint64_t *bitmap, c8_address_t address) {
+	return (bitmap[address / 64] >> (address % 64)) & 0x1;
+}
+
+/**
+ * A watchpoint has been hit, stop before the next instruction.
+ *
+ * \param address The address accessed.
+ * \param access "read" or "write".
+ *
+ * \return void
+ */
+void debugger_watch_hit(c8_address_t address, const char *access) {
+	printf("Watchpoint: %s at %03x\n", access, address);
+	debugger.paused = true;
+}
+
+/**
+ * A log-linear latency histogram, HDR-style: 8 sub-buckets per power of two.
+ */
+typedef struct {
+	/**
+	 * Samples per bucket.
+	 */
+	uint64_t counts[HISTOGRAM_BUCKETS];
+
+	/**
+	 * Samples in total.
+	 */
+	uint64_t total;
+
+	/**
+	 * The largest sample.
+	 */
+	uint64_t max;
+} Histogram_t;
+
+/**
+ * Runtime counters. One set per thread, so no locking.
+ */
+typedef struct {
+	/**
+	 * Instructions executed.
+	 */
+	uint64_t instructions;
+
+	/**
+	 * Instructions executed running ahead, rolled back and not in the above.
+	 */
+	uint64_t speculative;
+
+	/**
+	 * Instructions per second, over the last interval.
+	 */
+	uint64_t ips;
+
+	/**
+	 * Emulated frames.
+	 */
+	uint64_t frames;
+
+	/**
+	 * Frames that took more than 1.5 frame periods.
+	 */
+	uint64_t late;
+
+	/**
+	 * Whole frame periods missed.
+	 */
+	uint64_t dropped;
+
+	/**
+	 * SDL event queue depth, last seen.
+	 */
+	uint64_t events;
+
+	/**
+	 * SDL event queue depth, largest seen.
+	 */
+	uint64_t max_events;
+
+	/**
+	 * Wall time per emulated frame, in nanoseconds.
+	 */
+	Histogram_t frame_time;
+
+	/**
+	 * Time to render and present, in nanoseconds.
+	 */
+	Histogram_t present_time;
+} Telemetry_t;
+
+/**
+ * This thread's telemetry.
+ */
+_Thread_local Telemetry_t telemetry;
+
+/**
+ * The monotonic clock.
+ *
+ * \return uint64_t Nanoseconds.
+ */
+uint64_t clock_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Record a sample in a histogram.
+ *
+ * \param histogram The histogram.
+ * \param value The sample.
+ *
+ * \return void
+ */
+void histogram_record(Histogram_t *histogram, uint64_t value) {
+	int bucket = value;
+	if (value >= HISTOGRAM_SUB_BUCKETS) {
+		int msb = 63 - __builtin_clzll(value);
+		bucket = (msb - 2) * HISTOGRAM_SUB_BUCKETS + ((value >> (msb - 3)) & (HISTOGRAM_SUB_BUCKETS - 1));
+	}
+
+	histogram->counts[bucket]++;
+	histogram->total++;
+	if (value > histogram->max)
+		histogram->max = value;
+}
+
+/**
+ * The smallest value that lands in a histogram bucket.
+ *
+ * \param bucket The bucket.
+ *
+ * \return uint64_t The value.
+ */
+uint64_t histogram_bucket_floor(int bucket) {
+	if (bucket < HISTOGRAM_SUB_BUCKETS)
+		return bucket;
+	return (uint64_t)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << (bucket / HISTOGRAM_SUB_BUCKETS - 1);
+}
+
+/**
+ * Estimate a percentile from a histogram.
+ *
+ * \param histogram The histogram.
+ * \param percentile The percentile, 0 to 100.
+ *
+ * \return uint64_t The floor of the bucket the percentile falls in.
+ */
+uint64_t histogram_percentile(Histogram_t *histogram, double percentile) {
+	uint64_t target = histogram->total * percentile / 100;
+	uint64_t seen = 0;
+	for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+		seen += histogram->counts[bucket];
+		if (seen > target)
+			return histogram_bucket_floor(bucket);
+	}
+	return histogram->max;
+}
+
 /**
  * Retrieve one byte of data from RAM.
  *
@@ -143,6 +517,9 @@ uint8_t ram_get_byte(RAM_t ram, c8_address_t address) {
 		fprintf(stderr, "Segmentation fault!");
 		exit(-1);
 	}
+	if (debugger.armed && bitmap_test(debugger.watch_read, address)) {
+		debugger_watch_hit(address, "read");
+	}
 	return ram[address];
 }
 
@@ -160,6 +537,9 @@ void ram_write_byte(RAM_t ram, c8_address_t address, uint8_t byte) {
 		fprintf(stderr, "Segmentation fault!");
 		exit(-1);
 	}
+	if (debugger.armed && bitmap_test(debugger.watch_write, address)) {
+		debugger_watch_hit(address, "write");
+	}
 	ram[address] = byte;
 }
 
@@ -186,15 +566,42 @@ c8_instruction_t ram_get_instruction(RAM_t ram, c8_address_t address) {
  * \return void
  */
 void ram_load_file(RAM_t ram, c8_address_t offset, FILE *file) {
-	while (!feof(file) ) {
+	int byte;
+	while ((byte = fgetc(file)) != EOF) {
 		if (offset >= RAM_SIZE) {
 			fprintf(stderr, "Buffer overflow!");
 			exit(-1);
 		}
-		ram[offset++] = fgetc(file);
+		ram[offset++] = byte;
 	}
 }
 
+/**
+ * Read a ROM image that has to fit in RAM after ROM_OFFSET.
+ *
+ * \param path The ROM file.
+ * \param image The buffer to read into.
+ * \param size Set to the number of bytes read.
+ *
+ * \return const char * What went wrong, NULL on success.
+ */
+const char *ram_read_rom(const char *path, uint8_t image[RAM_SIZE - ROM_OFFSET], size_t *size) {
+	FILE *rom = fopen(path, "rb");
+	if (!rom)
+		return "Can't open";
+
+	*size = fread(image, 1, RAM_SIZE - ROM_OFFSET, rom);
+	bool overflow = fgetc(rom) != EOF;
+	bool error = ferror(rom);
+	fclose(rom);
+
+	if (error)
+		return "Can't read";
+	if (overflow)
+		return "Too large";
+	return NULL;
+}
+
 /**
  * Preload sprites for characters 0-F in RAM.
  *
@@ -244,6 +651,10 @@ void cpu_reset(CPU_t *cpu) {
 	}
 	cpu->i = 0;
 	cpu->flags.HALT = 0;
+	cpu->flags.SPECULATIVE = 0;
+	cpu->flags.MUTE = 0;
+	cpu->fault = NULL;
+	cpu->fault_instruction = 0;
 
 	for (int sp = 0; sp < NELEMS(cpu->stack); sp++) {
 		cpu->stack[sp] = 0;
@@ -253,9 +664,13 @@ void cpu_reset(CPU_t *cpu) {
 	cpu->input = 0;
 
 	cpu->ram = 0;
+	cpu->decoded = NULL;
 
 	cpu->delay = 0;
 	cpu->sound = 0;
+
+	cpu->cycles = 0;
+	cpu->seed = 0;
 }
 
 /**
@@ -330,7 +745,7 @@ void display_clear(Display_t *display) {
  * \return bool Whether pixels were turned from on to off.
  */
 bool display_draw_row(Display_t *display, uint8_t row, uint8_t x, uint8_t y) {
-	if (y >= DISPLAY_H)
+	if (y >= DISPLAY_H || x >= DISPLAY_W)
 		return false;
 
 	/** Mirror the row */
@@ -340,9 +755,8 @@ bool display_draw_row(Display_t *display, uint8_t row, uint8_t x, uint8_t y) {
 
 	uint64_t before = display->p[y];
 	display->p[y] ^= ((uint64_t)row) << x;
-	uint64_t after = display->p[y];
 
-	return before > after;
+	return (before & (((uint64_t)row) << x)) != 0;
 }
 
 /**
@@ -353,6 +767,12 @@ bool display_draw_row(Display_t *display, uint8_t row, uint8_t x, uint8_t y) {
  * \return void
  */
 void display_render(Display_t *display) {
+	/** Headless */
+	if (!display->renderer)
+		return;
+
+	uint64_t start = clock_ns();
+
 	/** Draw */
 	for (int y = 0; y < DISPLAY_H; y++) {
 		uint64_t p = display->p[y];
@@ -367,6 +787,44 @@ void display_render(Display_t *display) {
 
 	SDL_SetRenderDrawColor(display->renderer, PIXEL_UNSET, SDL_ALPHA_OPAQUE);
 	SDL_RenderClear(display->renderer);
+
+	histogram_record(&telemetry.present_time, clock_ns() - start);
+}
+
+/**
+ * Halt the CPU on a guest error.
+ *
+ * \param cpu The CPU.
+ * \param fault What went wrong.
+ * \param instruction The instruction that faulted.
+ *
+ * \return void
+ */
+void cpu_fault(CPU_t *cpu, const char *fault, c8_instruction_t instruction) {
+	cpu->fault = fault;
+	cpu->fault_instruction = instruction;
+	cpu->flags.HALT = 1;
+}
+
+/**
+ * Stop fetching from the decoded instructions once code they cover is
+ * written to, the analysis couldn't rule it out.
+ *
+ * \param cpu The CPU.
+ * \param address The first address written to.
+ * \param length How many bytes.
+ *
+ * \return void
+ */
+void cpu_write_code(CPU_t *cpu, c8_address_t address, int length) {
+	if (!cpu->decoded)
+		return;
+	for (int a = address ? address - 1 : 0; a < address + length; a++) {
+		if (cpu->decoded[a]) {
+			cpu->decoded = NULL;
+			return;
+		}
+	}
 }
 
 /**
@@ -389,8 +847,7 @@ void cpu_execute(CPU_t *cpu, c8_instruction_t instruction) {
 
 	} else if (/* 00EE */ instruction == 0x00ee /* Return */) {
 		if (cpu->sp < 1) {
-			fprintf(stderr, "Stack underrun! HALTING!\n");
-			cpu->flags.HALT = 1;
+			cpu_fault(cpu, "Stack underrun", instruction);
 			return;
 		}
 		cpu->pc = cpu->stack[--cpu->sp];
@@ -402,8 +859,7 @@ void cpu_execute(CPU_t *cpu, c8_instruction_t instruction) {
 	} else if (/* 2NNN */ ((instruction >> 12) & 0xf) == 0x2 /* Call NNN */) {
 		/** Stack overflow. */
 		if (cpu->sp == NELEMS(cpu->stack)) {
-			fprintf(stderr, "Stack overlow! HALTING!\n");
-			cpu->flags.HALT = 1;
+			cpu_fault(cpu, "Stack overflow", instruction);
 			return;
 		}
 
@@ -466,11 +922,16 @@ void cpu_execute(CPU_t *cpu, c8_instruction_t instruction) {
 		cpu->i = instruction & 0xfff;
 
 	} else if (/* CXNN */ ((instruction >> 12) & 0xf) == 0xc /* Set VX to a random number masked with NN */) {
-		cpu->v[instruction >> 8 & 0xf] = (rand() & (instruction & 0xff)) & 0xff;
+		cpu->v[instruction >> 8 & 0xf] = (rand_r(&cpu->seed) & (instruction & 0xff)) & 0xff;
 	
 	} else if (/* DXYN */ ((instruction >> 12) & 0xf) == 0xd /* Draw 8xN sprite at VX VY, set VF to screen set */) {
 		bool unset = false;
 
+		if (cpu->i + (instruction & 0xf) > RAM_SIZE) {
+			cpu_fault(cpu, "Segmentation fault", instruction);
+			return;
+		}
+
 		uint8_t x = cpu->v[(instruction >> 8) & 0xf];
 		uint8_t y = cpu->v[(instruction & 0xf0) >> 4];
 		for (uint8_t h = 0; h < (instruction & 0xf); h++) {
@@ -483,11 +944,11 @@ void cpu_execute(CPU_t *cpu, c8_instruction_t instruction) {
 		display_render(cpu->display);
 
 	} else if (/* EX9E */ (((instruction >> 12) & 0xf) == 0xe) && ((instruction & 0xff) == 0x9e) /* Skip instruction if key VS is pressed */) {
-		if (((cpu->input >> cpu->v[instruction >> 8 & 0xf]) & 0x1))
+		if (((cpu->input >> (cpu->v[instruction >> 8 & 0xf] & 0xf)) & 0x1))
 			cpu->pc += INSTRUCTION_LENGTH;
 
 	} else if (/* EXA1 */ (((instruction >> 12) & 0xf) == 0xe) && ((instruction & 0xff) == 0xa1) /* Skip instruction if key VX is not pressed */) {
-		if (!((cpu->input >> cpu->v[instruction >> 8 & 0xf]) & 0x1))
+		if (!((cpu->input >> (cpu->v[instruction >> 8 & 0xf] & 0xf)) & 0x1))
 			cpu->pc += INSTRUCTION_LENGTH;
 		
 	} else if (/* FX07 */ (((instruction >> 12) & 0xf) == 0xf) && ((instruction & 0xff) == 0x07) /* Read delay timer to VX */) {
@@ -513,7 +974,7 @@ void cpu_execute(CPU_t *cpu, c8_instruction_t instruction) {
 		cpu->sound = cpu->v[instruction >> 8 & 0xf];
 
 	} else if (/* FX1E */ (((instruction >> 12) & 0xf) == 0xf) && ((instruction & 0xff) == 0x1e) /* I = I + VX */) {
-		cpu->i += cpu->v[instruction >> 8 & 0xf]; /** \todo can we overrun here? */
+		cpu->i += cpu->v[instruction >> 8 & 0xf]; /** May point past RAM, checked on access */
 
 	} else if (/* FX29 */ (((instruction >> 12) & 0xf) == 0xf) && ((instruction & 0xff) == 0x29) /* Set I to sprite in digit VX */) {
 		cpu->i = BUILTIN_SPRITES_OFFSET + (cpu->v[instruction >> 8 & 0xf] * 5);
@@ -521,23 +982,37 @@ void cpu_execute(CPU_t *cpu, c8_instruction_t instruction) {
 	} else if (/* FX33 */ (((instruction >> 12) & 0xf) == 0xf) && ((instruction & 0xff) == 0x33) /** BCD VX to I */) {
 		uint8_t value = cpu->v[instruction >> 8 & 0xf];
 
+		if (cpu->i + 3 > RAM_SIZE) {
+			cpu_fault(cpu, "Segmentation fault", instruction);
+			return;
+		}
+
+		cpu_write_code(cpu, cpu->i, 3);
 		ram_write_byte(cpu->ram, cpu->i, (value / 100) % 10);
 		ram_write_byte(cpu->ram, cpu->i + 1, (value / 10) % 10);
 		ram_write_byte(cpu->ram, cpu->i + 2, (value / 1) % 10);
 	
 	} else if (/* FX55 */ (((instruction >> 12) & 0xf) == 0xf) && ((instruction & 0xff) == 0x55) /* Fill I from V0 to VX */) {
+		if (cpu->i + (instruction >> 8 & 0xf) + 1 > RAM_SIZE) {
+			cpu_fault(cpu, "Segmentation fault", instruction);
+			return;
+		}
+		cpu_write_code(cpu, cpu->i, (instruction >> 8 & 0xf) + 1);
 		for (int i = 0; i <= (instruction >> 8 & 0xf); i++) {
 			ram_write_byte(cpu->ram, cpu->i++, cpu->v[i]);
 		}
 
 	} else if (/* FX65 */ (((instruction >> 12) & 0xf) == 0xf) && ((instruction & 0xff) == 0x65) /* Fill V0 to VX from I */) {
+		if (cpu->i + (instruction >> 8 & 0xf) + 1 > RAM_SIZE) {
+			cpu_fault(cpu, "Segmentation fault", instruction);
+			return;
+		}
 		for (int i = 0; i <= (instruction >> 8 & 0xf); i++) {
 			cpu->v[i] = ram_get_byte(cpu->ram, cpu->i + i);
 		}
 
 	} else {
-		fprintf(stderr, "Unknown instruction %04x! HALTING!\n", instruction);
-		cpu->flags.HALT = 1;
+		cpu_fault(cpu, "Unknown instruction", instruction);
 		return;
 	}
 
@@ -546,60 +1021,2296 @@ void cpu_execute(CPU_t *cpu, c8_instruction_t instruction) {
 }
 
 /**
- * Trigger sound indicator.
+ * Disassemble an instruction.
  *
- * \param cpu The CPU.
+ * \param instruction The instruction.
+ * \param buffer The buffer to write the mnemonic to.
+ * \param size The size of the buffer.
  *
  * \return void
  */
-void beep(CPU_t *cpu) {
-	printf("BEEP :)\n");
+void cpu_disassemble(c8_instruction_t instruction, char *buffer, size_t size) {
+	uint8_t x = instruction >> 8 & 0xf;
+	uint8_t y = (instruction & 0xf0) >> 4;
+	uint8_t nn = instruction & 0xff;
+	uint16_t nnn = instruction & 0xfff;
+
+	switch (instruction >> 12) {
+		case 0x0:
+			if (instruction == 0x00e0) { snprintf(buffer, size, "CLS"); return; }
+			if (instruction == 0x00ee) { snprintf(buffer, size, "RET"); return; }
+			break;
+		case 0x1: snprintf(buffer, size, "JP %03x", nnn); return;
+		case 0x2: snprintf(buffer, size, "CALL %03x", nnn); return;
+		case 0x3: snprintf(buffer, size, "SE V%X, %02x", x, nn); return;
+		case 0x4: snprintf(buffer, size, "SNE V%X, %02x", x, nn); return;
+		case 0x5:
+			if ((instruction & 0xf) == 0x0) { snprintf(buffer, size, "SE V%X, V%X", x, y); return; }
+			break;
+		case 0x6: snprintf(buffer, size, "LD V%X, %02x", x, nn); return;
+		case 0x7: snprintf(buffer, size, "ADD V%X, %02x", x, nn); return;
+		case 0x8: {
+			static const char *ops[16] = {
+				"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+				NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL
+			};
+			if (ops[instruction & 0xf]) { snprintf(buffer, size, "%s V%X, V%X", ops[instruction & 0xf], x, y); return; }
+			break;
+		}
+		case 0x9:
+			if ((instruction & 0xf) == 0x0) { snprintf(buffer, size, "SNE V%X, V%X", x, y); return; }
+			break;
+		case 0xa: snprintf(buffer, size, "LD I, %03x", nnn); return;
+		case 0xc: snprintf(buffer, size, "RND V%X, %02x", x, nn); return;
+		case 0xd: snprintf(buffer, size, "DRW V%X, V%X, %x", x, y, instruction & 0xf); return;
+		case 0xe:
+			if (nn == 0x9e) { snprintf(buffer, size, "SKP V%X", x); return; }
+			if (nn == 0xa1) { snprintf(buffer, size, "SKNP V%X", x); return; }
+			break;
+		case 0xf:
+			switch (nn) {
+				case 0x07: snprintf(buffer, size, "LD V%X, DT", x); return;
+				case 0x0a: snprintf(buffer, size, "LD V%X, K", x); return;
+				case 0x15: snprintf(buffer, size, "LD DT, V%X", x); return;
+				case 0x18: snprintf(buffer, size, "LD ST, V%X", x); return;
+				case 0x1e: snprintf(buffer, size, "ADD I, V%X", x); return;
+				case 0x29: snprintf(buffer, size, "LD F, V%X", x); return;
+				case 0x33: snprintf(buffer, size, "LD B, V%X", x); return;
+				case 0x55: snprintf(buffer, size, "LD [I], V%X", x); return;
+				case 0x65: snprintf(buffer, size, "LD V%X, [I]", x); return;
+			}
+			break;
+	}
+
+	snprintf(buffer, size, "DW %04x", instruction);
 }
 
 /**
- * Decrement the CPU timers.
- *
- * \param cpu The CPU that ticked.
+ * Recalculate whether the debugger needs to be consulted at all.
  *
  * \return void
  */
-void cpu_timer_tick(CPU_t *cpu) {
-	if (cpu->delay) cpu->delay--;
-	if (cpu->sound) {
-		if (--cpu->sound == 0) beep(cpu);
+void debugger_update_armed(void) {
+	debugger.armed = debugger.paused;
+	for (int w = 0; w < NELEMS(debugger.breakpoints); w++) {
+		if (debugger.breakpoints[w] || debugger.watch_read[w] || debugger.watch_write[w])
+			debugger.armed = true;
 	}
 }
 
-
+/**
+ * Whether the debugger wants to stop before the current instruction.
+ *
+ * Only worth calling when debugger.armed is set.
+ *
+ * \param cpu The CPU.
+ *
+ * \return bool Whether to stop.
+ */
+bool debugger_check(CPU_t *cpu) {
+	return debugger.paused || bitmap_test(debugger.breakpoints, cpu->pc % RAM_SIZE);
+}
+
+/**
+ * Interact with the debugger on stdin until told to carry on.
+ *
+ * \param cpu The stopped CPU.
+ *
+ * \return bool False if asked to quit.
+ */
+bool debugger_prompt(CPU_t *cpu) {
+	char line[128];
+	char mnemonic[32];
+
+	if (cpu->pc <= RAM_SIZE - INSTRUCTION_LENGTH) {
+		cpu_disassemble(ram_get_instruction(cpu->ram, cpu->pc), mnemonic, sizeof(mnemonic));
+		printf("%03x: %s\n", cpu->pc, mnemonic);
+	}
+
+	while (true) {
+		printf("(c8) ");
+		fflush(stdout);
+
+		if (!fgets(line, sizeof(line), stdin))
+			return false;
+
+		char command[8] = { 0 };
+		unsigned int address = cpu->pc;
+		unsigned int count = 0;
+		int args = sscanf(line, "%7s %x %x", command, &address, &count);
+		if (args < 1)
+			continue;
+		address %= RAM_SIZE;
+
+		if (NULL) {
+
+		} else if (!strcmp(command, "c") /* Continue */) {
+			debugger.paused = false;
+			debugger_update_armed();
+			return true;
+
+		} else if (!strcmp(command, "s") /* Step */) {
+			debugger.paused = true;
+			debugger.armed = true;
+			return true;
+
+		} else if (!strcmp(command, "q") /* Quit */) {
+			return false;
+
+		} else if (!strcmp(command, "b") /* Breakpoint */) {
+			bitmap_set(debugger.breakpoints, address);
+
+		} else if (!strcmp(command, "rw") /* Read watchpoint */) {
+			bitmap_set(debugger.watch_read, address);
+
+		} else if (!strcmp(command, "ww") /* Write watchpoint */) {
+			bitmap_set(debugger.watch_write, address);
+
+		} else if (!strcmp(command, "d") /* Delete everything at address */) {
+			bitmap_clear(debugger.breakpoints, address);
+			bitmap_clear(debugger.watch_read, address);
+			bitmap_clear(debugger.watch_write, address);
+
+		} else if (!strcmp(command, "r") /* Registers */) {
+			cpu_dump(cpu);
+			printf("I = %04x, SP = %02x, DT = %02x, ST = %02x, INPUT = %04x\n",
+				cpu->i, cpu->sp, cpu->delay, cpu->sound, cpu->input);
+
+		} else if (!strcmp(command, "x") /* Examine RAM */) {
+			count = args < 3 ? 16 : count;
+			for (unsigned int offset = 0; offset < count && address + offset < RAM_SIZE; offset++) {
+				if (offset % 16 == 0)
+					printf(offset ? "\n%03x:" : "%03x:", address + offset);
+				printf(" %02x", cpu->ram[address + offset]);
+			}
+			printf("\n");
+
+		} else if (!strcmp(command, "l") /* List disassembly */) {
+			count = args < 3 ? 8 : count;
+			for (unsigned int n = 0; n < count && address <= RAM_SIZE - INSTRUCTION_LENGTH; n++) {
+				c8_instruction_t instruction = (cpu->ram[address] << 8) | cpu->ram[address + 1];
+				cpu_disassemble(instruction, mnemonic, sizeof(mnemonic));
+				printf("%c%03x: %04x  %s\n", bitmap_test(debugger.breakpoints, address) ? '*' : ' ',
+					address, instruction, mnemonic);
+				address += INSTRUCTION_LENGTH;
+			}
+
+		} else {
+			printf("c: continue, s: step, q: quit\n");
+			printf("b/rw/ww ADDR: break on PC, watch reads, watch writes; d ADDR: delete\n");
+			printf("r: registers, x [ADDR] [LEN]: examine RAM, l [ADDR] [N]: disassemble\n");
+		}
+
+		debugger_update_armed();
+	}
+}
+
+/**
+ * Trigger sound indicator.
+ *
+ * \param cpu The CPU.
+ *
+ * \return void
+ */
+void beep(CPU_t *cpu) {
+	if (cpu->flags.SPECULATIVE || cpu->flags.MUTE)
+		return;
+	printf("BEEP :)\n");
+}
+
+/**
+ * Decrement the CPU timers.
+ *
+ * \param cpu The CPU that ticked.
+ *
+ * \return void
+ */
+void cpu_timer_tick(CPU_t *cpu) {
+	if (cpu->delay) cpu->delay--;
+	if (cpu->sound) {
+		if (--cpu->sound == 0) beep(cpu);
+	}
+}
+
+
 /**
  * Poll input and write state to CPU.
  *
- * \param cpu The CPU to write state to.
- * \param keys The SDL keys array.
+ * \param cpu The CPU to write state to.
+ * \param keys The SDL keys array.
+ *
+ * \return void
+ */
+void cpu_poll_keystate(CPU_t *cpu, const uint8_t *keys) {
+	/** Setup keypresses */
+	cpu->input = ( 0
+		/** Map your own keys https://wiki.libsdl.org/SDL_Scancode */
+		| ((keys[SDL_SCANCODE_Z]) ? 1 << 0x0 : 0)
+		| ((keys[SDL_SCANCODE_X]) ? 1 << 0x1 : 0)
+		| ((keys[SDL_SCANCODE_C]) ? 1 << 0x2 : 0)
+		| ((keys[SDL_SCANCODE_V]) ? 1 << 0x3 : 0)
+		| ((keys[SDL_SCANCODE_A]) ? 1 << 0x4 : 0)
+		| ((keys[SDL_SCANCODE_S]) ? 1 << 0x5 : 0)
+		| ((keys[SDL_SCANCODE_D]) ? 1 << 0x6 : 0)
+		| ((keys[SDL_SCANCODE_F]) ? 1 << 0x7 : 0)
+		| ((keys[SDL_SCANCODE_Q]) ? 1 << 0x8 : 0)
+		| ((keys[SDL_SCANCODE_W]) ? 1 << 0x9 : 0)
+		| ((keys[SDL_SCANCODE_E]) ? 1 << 0xa : 0)
+		| ((keys[SDL_SCANCODE_R]) ? 1 << 0xb : 0)
+		| ((keys[SDL_SCANCODE_1]) ? 1 << 0xc : 0)
+		| ((keys[SDL_SCANCODE_2]) ? 1 << 0xd : 0)
+		| ((keys[SDL_SCANCODE_3]) ? 1 << 0xe : 0)
+		| ((keys[SDL_SCANCODE_4]) ? 1 << 0xf : 0)
+	);
+}
+
+/**
+ * Find where control can go after an instruction.
+ *
+ * Return targets (00EE) are not known statically and are covered by the
+ * instruction following the call instead.
+ *
+ * \param instruction The instruction.
+ * \param address The address of the instruction.
+ * \param successors Filled with up to 2 successor addresses.
+ *
+ * \return int The number of successors, 0 when control flow ends or is unknown.
+ */
+int cpu_successors(c8_instruction_t instruction, c8_address_t address, c8_address_t successors[2]) {
+	c8_address_t next = address + INSTRUCTION_LENGTH;
+
+	switch ((instruction >> 12) & 0xf) {
+		case 0x0:
+			if (instruction == 0x00e0) break;
+			return 0; /** 00EE and unknown */
+		case 0x1:
+			successors[0] = instruction & 0xfff;
+			return 1;
+		case 0x2:
+			successors[0] = instruction & 0xfff;
+			successors[1] = next;
+			return 2;
+		case 0x3: case 0x4:
+			successors[0] = next;
+			successors[1] = next + INSTRUCTION_LENGTH;
+			return 2;
+		case 0x5: case 0x9:
+			if ((instruction & 0xf) != 0x0) return 0;
+			successors[0] = next;
+			successors[1] = next + INSTRUCTION_LENGTH;
+			return 2;
+		case 0x8:
+			switch (instruction & 0xf) {
+				case 0x0: case 0x1: case 0x2: case 0x3: case 0x4:
+				case 0x5: case 0x6: case 0x7: case 0xe:
+					break;
+				default:
+					return 0;
+			}
+			break;
+		case 0xb:
+			return 0; /** Not implemented */
+		case 0xe:
+			if ((instruction & 0xff) != 0x9e && (instruction & 0xff) != 0xa1) return 0;
+			successors[0] = next;
+			successors[1] = next + INSTRUCTION_LENGTH;
+			return 2;
+		case 0xf:
+			switch (instruction & 0xff) {
+				case 0x07: case 0x0a: case 0x15: case 0x18: case 0x1e:
+				case 0x29: case 0x33: case 0x55: case 0x65:
+					break;
+				default:
+					return 0;
+			}
+			break;
+	}
+
+	successors[0] = next;
+	return 1;
+}
+
+/**
+ * A basic block: straight-line code with one way in, at the start.
+ */
+typedef struct {
+	/**
+	 * The address of the first instruction.
+	 */
+	c8_address_t start;
+
+	/**
+	 * The address past the last instruction.
+	 */
+	c8_address_t end;
+
+	/**
+	 * Where control goes after the last instruction.
+	 */
+	c8_address_t successors[2];
+
+	/**
+	 * The number of successors.
+	 */
+	uint8_t count;
+
+	/**
+	 * BLOCK_* flags.
+	 */
+	uint8_t flags;
+} Block_t;
+
+/**
+ * What a static analysis of a ROM found.
+ */
+typedef struct {
+	/**
+	 * A RAM_SIZE bitmap of addresses instructions start at.
+	 */
+	uint64_t instructions[RAM_SIZE / 64];
+
+	/**
+	 * A RAM_SIZE bitmap of bytes executed as code.
+	 */
+	uint64_t code[RAM_SIZE / 64];
+
+	/**
+	 * A RAM_SIZE bitmap of bytes read as data: sprites and loads.
+	 */
+	uint64_t data[RAM_SIZE / 64];
+
+	/**
+	 * A RAM_SIZE bitmap of bytes that may be written or jumped into at runtime.
+	 */
+	uint64_t dynamic[RAM_SIZE / 64];
+
+	/**
+	 * Something writes through an I that couldn't be worked out, any byte may change.
+	 */
+	bool unknown_writes;
+
+	/**
+	 * The size of the ROM.
+	 */
+	uint16_t size;
+
+	/**
+	 * The number of blocks.
+	 */
+	uint16_t block_count;
+
+	/**
+	 * The blocks, by start address.
+	 */
+	Block_t blocks[RAM_SIZE];
+} Analysis_t;
+
+/**
+ * Mark a range in a RAM_SIZE bitmap, clipped to RAM.
+ *
+ * \param bitmap The bitmap.
+ * \param address The first address.
+ * \param length How many.
+ *
+ * \return void
+ */
+void bitmap_set_range(uint64_t *bitmap, unsigned int address, unsigned int length) {
+	for (unsigned int a = address; a < address + length && a < RAM_SIZE; a++)
+		bitmap_set(bitmap, a);
+}
+
+/**
+ * Follow what a block does to I and memory.
+ *
+ * I is only tracked within the block: it's unknown on the way in.
+ *
+ * \param analysis The analysis.
+ * \param ram The RAM with the ROM loaded.
+ * \param block The block.
+ *
+ * \return void
+ */
+void analysis_track_memory(Analysis_t *analysis, RAM_t ram, Block_t *block) {
+	int i = -1; /** Unknown */
+
+	for (c8_address_t address = block->start; address < block->end; address += INSTRUCTION_LENGTH) {
+		c8_instruction_t instruction = ram_get_instruction(ram, address);
+		uint8_t x = instruction >> 8 & 0xf;
+
+		if ((instruction >> 12) == 0xa) {
+			i = instruction & 0xfff;
+		} else if ((instruction >> 12) == 0xd) {
+			if (i >= 0)
+				bitmap_set_range(analysis->data, i, instruction & 0xf);
+		} else if ((instruction >> 12) == 0xf) {
+			switch (instruction & 0xff) {
+				case 0x33:
+				case 0x55:
+					if (i < 0) {
+						analysis->unknown_writes = true;
+						block->flags |= BLOCK_WRITES;
+						break;
+					}
+					bitmap_set_range(analysis->dynamic, i, (instruction & 0xff) == 0x33 ? 3 : x + 1);
+					block->flags |= BLOCK_WRITES;
+					if ((instruction & 0xff) == 0x55)
+						i += x + 1;
+					break;
+				case 0x65:
+					if (i >= 0)
+						bitmap_set_range(analysis->data, i, x + 1);
+					break;
+				case 0x1e:
+				case 0x29:
+					i = -1;
+					break;
+			}
+		}
+	}
+}
+
+/**
+ * Analyse a ROM: discover its code from the ROM offset and split it into blocks.
+ *
+ * Code is followed through jumps, calls, skips and returns (via the
+ * instruction after each call). BNNN jumps can't be followed, so their
+ * blocks are flagged dynamic and the 256 bytes they may land in marked
+ * dynamic, as are bytes that FX33/FX55 write to where I can be worked out.
+ * Blocks with code in dynamic bytes are flagged dynamic too.
+ *
+ * \param analysis The analysis to fill in.
+ * \param ram The RAM with the ROM loaded.
+ * \param size The size of the ROM.
+ *
+ * \return void
+ */
+void analysis_build(Analysis_t *analysis, RAM_t ram, uint16_t size) {
+	uint64_t leaders[RAM_SIZE / 64] = { 0 };
+	c8_address_t work[RAM_SIZE];
+	int pending = 0;
+
+	memset(analysis, 0, sizeof(Analysis_t));
+	analysis->size = size;
+
+	work[pending++] = ROM_OFFSET;
+	bitmap_set(analysis->instructions, ROM_OFFSET);
+	bitmap_set(leaders, ROM_OFFSET);
+
+	while (pending) {
+		c8_address_t address = work[--pending];
+		c8_instruction_t instruction = ram_get_instruction(ram, address);
+		c8_address_t successors[2];
+
+		bitmap_set_range(analysis->code, address, INSTRUCTION_LENGTH);
+
+		if ((instruction >> 12) == 0xb)
+			bitmap_set_range(analysis->dynamic, instruction & 0xfff, 0x100);
+
+		int count = cpu_successors(instruction, address, successors);
+		bool branches = count != 1 || successors[0] != address + INSTRUCTION_LENGTH;
+
+		for (int s = 0; s < count; s++) {
+			/** Can't be fetched whole, left to the interpreter */
+			if (successors[s] > RAM_SIZE - INSTRUCTION_LENGTH)
+				continue;
+			if (branches)
+				bitmap_set(leaders, successors[s]);
+			if (bitmap_test(analysis->instructions, successors[s]))
+				continue;
+			bitmap_set(analysis->instructions, successors[s]);
+			work[pending++] = successors[s];
+		}
+
+		/** Whatever follows a dead end starts a block if it's code at all */
+		if (!count && address + INSTRUCTION_LENGTH <= RAM_SIZE - INSTRUCTION_LENGTH)
+			bitmap_set(leaders, address + INSTRUCTION_LENGTH);
+	}
+
+	/**
+	 * Code reached at both alignments overlaps byte for byte. Overlapping
+	 * instructions get blocks of their own and so does whatever follows
+	 * them, which keeps blocks from sharing more than a byte.
+	 */
+	for (int address = 0; address < RAM_SIZE - INSTRUCTION_LENGTH; address++) {
+		if (!bitmap_test(analysis->instructions, address) || !bitmap_test(analysis->instructions, address + 1))
+			continue;
+		for (int leader = address; leader <= address + 1 + INSTRUCTION_LENGTH && leader <= RAM_SIZE - INSTRUCTION_LENGTH; leader++)
+			bitmap_set(leaders, leader);
+	}
+
+	for (int start = 0; start < RAM_SIZE; start++) {
+		if (!bitmap_test(leaders, start) || !bitmap_test(analysis->instructions, start))
+			continue;
+
+		Block_t *block = &analysis->blocks[analysis->block_count++];
+		block->start = start;
+
+		c8_address_t address = start;
+		while (true) {
+			c8_instruction_t instruction = ram_get_instruction(ram, address);
+			c8_address_t next = address + INSTRUCTION_LENGTH;
+
+			block->count = cpu_successors(instruction, address, block->successors);
+
+			bool falls_through = block->count == 1 && block->successors[0] == next;
+			if (falls_through && next <= RAM_SIZE - INSTRUCTION_LENGTH
+					&& bitmap_test(analysis->instructions, next) && !bitmap_test(leaders, next)) {
+				address = next;
+				continue;
+			}
+
+			block->end = next;
+			if ((instruction >> 12) == 0x2)
+				block->flags |= BLOCK_CALL;
+			else if (instruction == 0x00ee)
+				block->flags |= BLOCK_RETURN;
+			else if ((instruction >> 12) == 0xb)
+				block->flags |= BLOCK_DYNAMIC;
+			else if (!block->count)
+				block->flags |= BLOCK_HALT;
+			break;
+		}
+
+		analysis_track_memory(analysis, ram, block);
+	}
+
+	/** Now that all the writes are known */
+	for (int b = 0; b < analysis->block_count; b++) {
+		Block_t *block = &analysis->blocks[b];
+		for (c8_address_t address = block->start; address < block->end; address++) {
+			if (bitmap_test(analysis->dynamic, address))
+				block->flags |= BLOCK_DYNAMIC;
+		}
+	}
+}
+
+/**
+ * Find the block an address is in.
+ *
+ * Blocks of overlapping code share at most a byte, the last of one block
+ * and the first of the next. The next one, the innermost, is found then.
+ *
+ * \param analysis The analysis.
+ * \param address The address.
+ *
+ * \return const Block_t * The block, NULL if the address isn't known code.
+ */
+const Block_t *analysis_find_block(const Analysis_t *analysis, c8_address_t address) {
+	/** The last block starting at or before the address */
+	int low = 0, high = analysis->block_count;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (analysis->blocks[middle].start <= address)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if (!low || address >= analysis->blocks[low - 1].end)
+		return NULL;
+	return &analysis->blocks[low - 1];
+}
+
+/**
+ * Dump an analysis: the control-flow graph with disassembly and a map of the ROM.
+ *
+ * \param analysis The analysis.
+ * \param ram The RAM with the ROM loaded.
+ * \param out The file to write to.
+ *
+ * \return void
+ */
+void analysis_dump(const Analysis_t *analysis, RAM_t ram, FILE *out) {
+	char mnemonic[32];
+
+	for (int b = 0; b < analysis->block_count; b++) {
+		const Block_t *block = &analysis->blocks[b];
+
+		fprintf(out, "Block %03x-%03x ->", block->start, block->end - 1);
+		for (int s = 0; s < block->count; s++)
+			fprintf(out, " %03x", block->successors[s]);
+		fprintf(out, "%s%s%s%s%s\n",
+			block->flags & BLOCK_CALL ? " [call]" : "",
+			block->flags & BLOCK_RETURN ? " [return]" : "",
+			block->flags & BLOCK_HALT ? " [halt]" : "",
+			block->flags & BLOCK_WRITES ? " [writes]" : "",
+			block->flags & BLOCK_DYNAMIC ? " [dynamic]" : "");
+
+		for (c8_address_t address = block->start; address < block->end; address += INSTRUCTION_LENGTH) {
+			c8_instruction_t instruction = ram_get_instruction(ram, address);
+			cpu_disassemble(instruction, mnemonic, sizeof(mnemonic));
+			fprintf(out, "  %03x: %04x  %s\n", address, instruction, mnemonic);
+		}
+	}
+
+	fprintf(out, "\nMap (C code, D data, c/d dynamic, . unknown)%s:\n",
+		analysis->unknown_writes ? ", some writes go to unknown addresses" : "");
+	for (int address = ROM_OFFSET; address < ROM_OFFSET + analysis->size && address < RAM_SIZE; address++) {
+		if ((address - ROM_OFFSET) % 64 == 0)
+			fprintf(out, "%s%03x: ", address == ROM_OFFSET ? "" : "\n", address);
+
+		char c = bitmap_test(analysis->code, address) ? 'C' : bitmap_test(analysis->data, address) ? 'D' : '.';
+		if (bitmap_test(analysis->dynamic, address))
+			c = c == 'C' ? 'c' : 'd';
+		fputc(c, out);
+	}
+	fprintf(out, "\n");
+}
+
+/**
+ * Fold some data into an FNV-1a hash.
+ *
+ * \param hash The hash so far, FNV_OFFSET to start.
+ * \param data The data.
+ * \param size The size of the data.
+ *
+ * \return uint64_t The new hash.
+ */
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+	const uint8_t *bytes = data;
+	for (size_t b = 0; b < size; b++) {
+		hash ^= bytes[b];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/**
+ * Precomputed artifacts for a ROM, stored in the cache directory and mapped
+ * read-only, so that every instance shares the same pages.
+ */
+typedef struct {
+	/**
+	 * CACHE_MAGIC.
+	 */
+	char magic[4];
+
+	/**
+	 * CACHE_VERSION.
+	 */
+	uint32_t version;
+
+	/**
+	 * sizeof(Cache_t), catches layout changes.
+	 */
+	uint32_t size;
+
+	/**
+	 * Quirks the ROM needs, none are implemented yet.
+	 */
+	uint32_t quirks;
+
+	/**
+	 * FNV-1a of the ROM.
+	 */
+	uint64_t hash;
+
+	/**
+	 * The size of the ROM.
+	 */
+	uint16_t rom_size;
+
+	/**
+	 * The ROM.
+	 */
+	uint8_t rom[RAM_SIZE - ROM_OFFSET];
+
+	/**
+	 * The instruction at each address code starts at, 0 elsewhere and
+	 * wherever it's known to change at runtime.
+	 */
+	c8_instruction_t decoded[RAM_SIZE];
+
+	/**
+	 * The analysis of the ROM.
+	 */
+	Analysis_t analysis;
+} Cache_t;
+
+/**
+ * Whether a cache entry is for this ROM and this version of the emulator.
+ *
+ * \param cache The cache entry.
+ * \param hash The hash of the ROM.
+ * \param rom The ROM.
+ * \param size The size of the ROM.
+ *
+ * \return bool Whether it's good to use.
+ */
+bool cache_valid(const Cache_t *cache, uint64_t hash, const uint8_t *rom, uint16_t size) {
+	return !memcmp(cache->magic, CACHE_MAGIC, sizeof(cache->magic))
+		&& cache->version == CACHE_VERSION
+		&& cache->size == sizeof(Cache_t)
+		&& cache->hash == hash
+		&& cache->rom_size == size
+		&& !memcmp(cache->rom, rom, size);
+}
+
+/**
+ * Map a cache entry file read-only.
+ *
+ * \param path The file.
+ *
+ * \return const Cache_t * The mapping, NULL if missing or the wrong size.
+ */
+const Cache_t *cache_map(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	const Cache_t *cache = NULL;
+	if (!fstat(fd, &st) && st.st_size == sizeof(Cache_t)) {
+		cache = mmap(NULL, sizeof(Cache_t), PROT_READ, MAP_SHARED, fd, 0);
+		cache = cache == MAP_FAILED ? NULL : cache;
+	}
+	close(fd);
+
+	return cache;
+}
+
+/**
+ * Unmap a cache entry.
+ *
+ * \param cache The cache entry.
+ *
+ * \return void
+ */
+void cache_close(const Cache_t *cache) {
+	munmap((void *)cache, sizeof(Cache_t));
+}
+
+/**
+ * The file name of a cache entry.
+ *
+ * Entries for other versions or layouts get other names, so emulators of
+ * different versions sharing a cache directory don't keep replacing each
+ * other's entries.
+ *
+ * \param path The buffer to write it to, PATH_MAX long.
+ * \param directory The cache directory.
+ * \param hash The hash of the ROM.
+ *
+ * \return void
+ */
+void cache_path(char path[PATH_MAX], const char *directory, uint64_t hash) {
+	snprintf(path, PATH_MAX, "%s/%016" PRIx64 "-v%d-%zu.c8cache", directory, hash, CACHE_VERSION, sizeof(Cache_t));
+}
+
+/**
+ * Get the cache entry for a ROM, building it if it's missing or stale.
+ *
+ * Entries are named after the hash of the ROM, the version and the layout.
+ * They are written to a temporary file and renamed into place, so readers
+ * never see half an entry and instances still mapping a stale one keep
+ * their copy.
+ *
+ * \param directory The cache directory.
+ * \param rom The ROM.
+ * \param size The size of the ROM.
+ *
+ * \return const Cache_t * The read-only cache entry, NULL if it can't be had.
+ */
+const Cache_t *cache_open(const char *directory, const uint8_t *rom, uint16_t size) {
+	uint64_t hash = fnv1a(FNV_OFFSET, rom, size);
+
+	char path[PATH_MAX];
+	cache_path(path, directory, hash);
+
+	const Cache_t *cache = cache_map(path);
+	if (cache && cache_valid(cache, hash, rom, size))
+		return cache;
+	if (cache)
+		cache_close(cache);
+
+	Cache_t *entry = calloc(1, sizeof(Cache_t));
+	if (!entry) {
+		fprintf(stderr, "Can't build cache entry, running uncached.\n");
+		return NULL;
+	}
+	memcpy(entry->magic, CACHE_MAGIC, sizeof(entry->magic));
+	entry->version = CACHE_VERSION;
+	entry->size = sizeof(Cache_t);
+	entry->hash = hash;
+	entry->rom_size = size;
+	memcpy(entry->rom, rom, size);
+
+	uint8_t ram[RAM_SIZE] = { 0 };
+	ram_load_digit_sprites(ram, BUILTIN_SPRITES_OFFSET);
+	memcpy(ram + ROM_OFFSET, rom, size);
+	analysis_build(&entry->analysis, ram, size);
+
+	/** Writes the analysis couldn't place are caught by cpu_write_code */
+	for (int address = 0; address < RAM_SIZE; address++) {
+		if (bitmap_test(entry->analysis.instructions, address) && !bitmap_test(entry->analysis.dynamic, address)
+				&& !bitmap_test(entry->analysis.dynamic, address + 1))
+			entry->decoded[address] = ram_get_instruction(ram, address);
+	}
+
+	char temporary[PATH_MAX + 16];
+	snprintf(temporary, sizeof(temporary), "%s.%d", path, getpid());
+	FILE *out = fopen(temporary, "wb");
+	bool written = out && fwrite(entry, sizeof(Cache_t), 1, out) == 1;
+	written = out && !fclose(out) && written;
+	free(entry);
+
+	if (!written || rename(temporary, path)) {
+		fprintf(stderr, "Can't write to cache %s.\n", directory);
+		unlink(temporary);
+		return NULL;
+	}
+
+	return cache_map(path);
+}
+
+/**
+ * Translate the ROM in RAM into C source code.
+ *
+ * Every instruction the analysis found becomes a case of an `aot_execute`
+ * function. Building with `-DAOT_ROM='"file.c"'` includes it in the
+ * emulator, which tries it before falling back to `cpu_execute` whenever it
+ * returns false: for addresses that were not discovered statically
+ * (computed jumps, data executed as code), that may be modified (dynamic)
+ * or whose code has been overwritten at runtime anyway.
+ *
+ * \param analysis The analysis of the ROM.
+ * \param ram The RAM with the ROM loaded.
+ * \param name The name of the ROM.
+ * \param out The file to write the source code to.
+ *
+ * \return void
+ */
+void aot_translate(const Analysis_t *analysis, RAM_t ram, const char *name, FILE *out) {
+
+	fprintf(out, "/**\n * \\file\n * Translated from %s by c8. Do not edit.\n */\n\n", name);
+
+	/** The ROM itself, for TEST=1 to check the translation against the interpreter */
+	fprintf(out, "const uint16_t aot_rom_size = %d;\n", analysis->size);
+	fprintf(out, "const uint8_t aot_rom[] = {");
+	for (int b = 0; b < analysis->size; b++)
+		fprintf(out, "%s0x%02x,", b % 12 ? " " : "\n\t", ram_get_byte(ram, ROM_OFFSET + b));
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "bool aot_execute(CPU_t *cpu) {\n");
+	fprintf(out, "\tif (cpu->flags.HALT) return true;\n\n");
+	fprintf(out, "\tswitch (cpu->pc) {\n");
+
+	for (int address = 0; address < RAM_SIZE; address++) {
+		if (!bitmap_test(analysis->instructions, address) || bitmap_test(analysis->dynamic, address))
+			continue;
+
+		c8_instruction_t instruction = ram_get_instruction(ram, address);
+		uint8_t x = instruction >> 8 & 0xf;
+		uint8_t y = (instruction & 0xf0) >> 4;
+		uint8_t nn = instruction & 0xff;
+		c8_address_t next = address + INSTRUCTION_LENGTH;
+
+		fprintf(out, "\tcase 0x%03x: /* %04x */\n", address, instruction);
+		/** Self-modified, let the interpreter deal with it */
+		fprintf(out, "\t\tif (cpu->ram[0x%03x] != 0x%02x || cpu->ram[0x%03x] != 0x%02x) return false;\n",
+			address, instruction >> 8, address + 1, nn);
+
+		switch (instruction >> 12) {
+			case 0x0:
+				if (instruction == 0x00e0) {
+					fprintf(out, "\t\tdisplay_clear(cpu->display);\n\t\tcpu->pc = 0x%03x;\n", next);
+				} else if (instruction == 0x00ee) {
+					fprintf(out, "\t\tif (cpu->sp < 1) {\n\t\t\tcpu_fault(cpu, \"Stack underrun\", 0x00ee);\n\t\t\treturn true;\n\t\t}\n");
+					fprintf(out, "\t\tcpu->pc = cpu->stack[--cpu->sp] + %d;\n", INSTRUCTION_LENGTH);
+				} else {
+					fprintf(out, "\t\tcpu_execute(cpu, 0x%04x);\n", instruction);
+				}
+				break;
+			case 0x1:
+				fprintf(out, "\t\tcpu->pc = 0x%03x;\n", instruction & 0xfff);
+				break;
+			case 0x2:
+				fprintf(out, "\t\tif (cpu->sp == NELEMS(cpu->stack)) {\n\t\t\tcpu_fault(cpu, \"Stack overflow\", 0x%04x);\n\t\t\treturn true;\n\t\t}\n", instruction);
+				fprintf(out, "\t\tcpu->stack[cpu->sp++] = 0x%03x;\n\t\tcpu->pc = 0x%03x;\n", address, instruction & 0xfff);
+				break;
+			case 0x3:
+				fprintf(out, "\t\tcpu->pc = cpu->v[0x%x] == 0x%02x ? 0x%03x : 0x%03x;\n", x, nn, next + INSTRUCTION_LENGTH, next);
+				break;
+			case 0x4:
+				fprintf(out, "\t\tcpu->pc = cpu->v[0x%x] != 0x%02x ? 0x%03x : 0x%03x;\n", x, nn, next + INSTRUCTION_LENGTH, next);
+				break;
+			case 0x5:
+			case 0x9:
+				if ((instruction & 0xf) == 0x0) {
+					fprintf(out, "\t\tcpu->pc = cpu->v[0x%x] %s cpu->v[0x%x] ? 0x%03x : 0x%03x;\n",
+						x, instruction >> 12 == 0x5 ? "==" : "!=", y, next + INSTRUCTION_LENGTH, next);
+					break;
+				}
+				fprintf(out, "\t\tcpu_execute(cpu, 0x%04x);\n", instruction);
+				break;
+			case 0x6:
+				fprintf(out, "\t\tcpu->v[0x%x] = 0x%02x;\n\t\tcpu->pc = 0x%03x;\n", x, nn, next);
+				break;
+			case 0x7:
+				fprintf(out, "\t\tcpu->v[0x%x] += 0x%02x;\n\t\tcpu->pc = 0x%03x;\n", x, nn, next);
+				break;
+			case 0x8:
+				/** In the interpreter's order, VF may be X or Y */
+				switch (instruction & 0xf) {
+					case 0x0:
+					case 0x1:
+					case 0x2:
+					case 0x3: {
+						static const char *ops[] = { "=", "|=", "&=", "^=" };
+						fprintf(out, "\t\tcpu->v[0x%x] %s cpu->v[0x%x];\n", x, ops[instruction & 0xf], y);
+						break;
+					}
+					case 0x4:
+						fprintf(out, "\t\t{\n\t\t\tuint8_t carry = cpu->v[0x%x];\n\t\t\tcpu->v[0x%x] += cpu->v[0x%x];\n", x, x, y);
+						fprintf(out, "\t\t\tcpu->v[0xf] = carry > cpu->v[0x%x];\n\t\t}\n", x);
+						break;
+					case 0x5:
+						fprintf(out, "\t\tcpu->v[0xf] = cpu->v[0x%x] <= cpu->v[0x%x];\n\t\tcpu->v[0x%x] -= cpu->v[0x%x];\n", y, x, x, y);
+						break;
+					case 0x6:
+						fprintf(out, "\t\tcpu->v[0xf] = cpu->v[0x%x] & 0x1;\n\t\tcpu->v[0x%x] = cpu->v[0x%x] >> 1;\n", y, x, y);
+						break;
+					case 0x7:
+						fprintf(out, "\t\tcpu->v[0xf] = cpu->v[0x%x] > cpu->v[0x%x];\n\t\tcpu->v[0x%x] = cpu->v[0x%x] - cpu->v[0x%x];\n", y, x, x, y, x);
+						break;
+					case 0xe:
+						fprintf(out, "\t\tcpu->v[0xf] = (cpu->v[0x%x] >> 7) & 0x1;\n\t\tcpu->v[0x%x] = cpu->v[0x%x] << 1;\n", y, x, y);
+						break;
+					default:
+						fprintf(out, "\t\tcpu_execute(cpu, 0x%04x);\n\t\treturn true;\n", instruction);
+						continue;
+				}
+				fprintf(out, "\t\tcpu->pc = 0x%03x;\n", next);
+				break;
+			case 0xa:
+				fprintf(out, "\t\tcpu->i = 0x%03x;\n\t\tcpu->pc = 0x%03x;\n", instruction & 0xfff, next);
+				break;
+			case 0xf:
+				switch (nn) {
+					case 0x07:
+						fprintf(out, "\t\tcpu->v[0x%x] = cpu->delay;\n", x);
+						break;
+					case 0x15:
+						fprintf(out, "\t\tcpu->delay = cpu->v[0x%x];\n", x);
+						break;
+					case 0x18:
+						fprintf(out, "\t\tcpu->sound = cpu->v[0x%x];\n", x);
+						break;
+					case 0x1e:
+						fprintf(out, "\t\tcpu->i += cpu->v[0x%x];\n", x);
+						break;
+					default:
+						fprintf(out, "\t\tcpu_execute(cpu, 0x%04x);\n\t\treturn true;\n", instruction);
+						continue;
+				}
+				fprintf(out, "\t\tcpu->pc = 0x%03x;\n", next);
+				break;
+			default:
+				/** Same semantics as the interpreter, minus the fetch and decode */
+				fprintf(out, "\t\tcpu_execute(cpu, 0x%04x);\n", instruction);
+				break;
+		}
+		fprintf(out, "\t\treturn true;\n");
+	}
+
+	fprintf(out, "\t}\n\n\treturn false;\n}\n");
+}
+
+#ifdef AOT_ROM
+#include AOT_ROM
+#endif
+
+/**
+ * Queue a frame for capture.
+ *
+ * Costs a compare and a copy of the pixels, never blocks. Frames identical
+ * to the last one are left out, the writer repeats it until the next.
+ *
+ * \param capture The capture.
+ * \param p The display pixels.
+ * \param frame The emulated frame number.
+ *
+ * \return void
+ */
+void capture_push(Capture_t *capture, const uint64_t p[DISPLAY_H], uint64_t frame) {
+	uint64_t head = atomic_load_explicit(&capture->head, memory_order_relaxed);
+
+	/** Only this thread writes slots, the last one pushed stays intact after the writer reads it */
+	if (head && !memcmp(capture->frames[(head - 1) % CAPTURE_QUEUE].p, p, sizeof(capture->frames[0].p)))
+		return;
+
+	if (head - atomic_load_explicit(&capture->tail, memory_order_acquire) == CAPTURE_QUEUE) {
+		capture->dropped++;
+		return;
+	}
+
+	Capture_Frame_t *slot = &capture->frames[head % CAPTURE_QUEUE];
+	memcpy(slot->p, p, sizeof(slot->p));
+	slot->frame = frame;
+
+	atomic_store_explicit(&capture->head, head + 1, memory_order_release);
+}
+
+/**
+ * Whether a display pixel is set.
+ *
+ * \param p The display pixels.
+ * \param x The x coordinate.
+ * \param y The y coordinate.
+ *
+ * \return bool Whether it's set.
+ */
+bool capture_pixel(const uint64_t p[DISPLAY_H], int x, int y) {
+	return (p[y] >> x) & 0x1;
+}
+
+/**
+ * Write a frame to a Y4M stream.
+ *
+ * \param capture The capture.
+ * \param p The display pixels.
+ *
+ * \return void
+ */
+void capture_write_y4m(Capture_t *capture, const uint64_t p[DISPLAY_H]) {
+	int w = DISPLAY_W * capture->scale;
+	int h = DISPLAY_H * capture->scale;
+
+	uint8_t row[w];
+
+	fprintf(capture->out, "FRAME\n");
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			row[x] = capture_pixel(p, x / capture->scale, y / capture->scale) ? 235 : 16;
+		}
+		fwrite(row, 1, w, capture->out);
+	}
+
+	/** Greyscale, flat chroma */
+	memset(row, 128, w);
+	for (int y = 0; y < h; y++) {
+		fwrite(row, 1, w / 2, capture->out);
+	}
+}
+
+/**
+ * Pack LZW codes into GIF data sub-blocks.
+ */
+typedef struct {
+	FILE *out;
+	uint8_t block[255];
+	int size;
+	uint32_t bits;
+	int count;
+} Capture_GIF_Bits_t;
+
+/**
+ * Write a code to the GIF bit stream.
+ *
+ * \param bits The bit stream.
+ * \param code The code.
+ * \param width The width of the code in bits.
+ *
+ * \return void
+ */
+void capture_gif_code(Capture_GIF_Bits_t *bits, uint32_t code, int width) {
+	bits->bits |= code << bits->count;
+	bits->count += width;
+
+	while (bits->count >= 8) {
+		bits->block[bits->size++] = bits->bits & 0xff;
+		bits->bits >>= 8;
+		bits->count -= 8;
+
+		if (bits->size == sizeof(bits->block)) {
+			fputc(bits->size, bits->out);
+			fwrite(bits->block, 1, bits->size, bits->out);
+			bits->size = 0;
+		}
+	}
+}
+
+/**
+ * Write a frame to an animated GIF.
+ *
+ * The image data is uncompressed LZW: two colours, 3-bit codes and a clear
+ * code every two pixels so the code width never grows.
+ *
+ * \param capture The capture.
+ * \param p The display pixels.
+ * \param delay How long to show it for, in hundredths of a second.
+ *
+ * \return void
+ */
+void capture_write_gif(Capture_t *capture, const uint64_t p[DISPLAY_H], uint16_t delay) {
+	int w = DISPLAY_W * capture->scale;
+	int h = DISPLAY_H * capture->scale;
+
+	/** Graphic control extension */
+	fwrite("\x21\xf9\x04\x00", 1, 4, capture->out);
+	fputc(delay & 0xff, capture->out);
+	fputc(delay >> 8, capture->out);
+	fwrite("\x00\x00", 1, 2, capture->out);
+
+	/** Image descriptor */
+	fwrite("\x2c\x00\x00\x00\x00", 1, 5, capture->out);
+	fputc(w & 0xff, capture->out);
+	fputc(w >> 8, capture->out);
+	fputc(h & 0xff, capture->out);
+	fputc(h >> 8, capture->out);
+	fputc(0, capture->out);
+
+	/** Minimum code size 2: codes 0-1 colours, 4 clear, 5 end */
+	fputc(2, capture->out);
+
+	Capture_GIF_Bits_t bits = { .out = capture->out };
+	int pixels = 0;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			if (pixels++ % 2 == 0)
+				capture_gif_code(&bits, 4, 3);
+			capture_gif_code(&bits, capture_pixel(p, x / capture->scale, y / capture->scale), 3);
+		}
+	}
+	capture_gif_code(&bits, 5, 3);
+	capture_gif_code(&bits, 0, 7); /** Flush */
+
+	if (bits.size) {
+		fputc(bits.size, capture->out);
+		fwrite(bits.block, 1, bits.size, capture->out);
+	}
+	fputc(0, capture->out);
+}
+
+/**
+ * Show a frame in an animated GIF for any length of time.
+ *
+ * GIF delays are 16 bits, longer holds are split across repeats of the
+ * frame. Every piece stays at least 2cs so viewers don't clamp it.
+ *
+ * \param capture The capture.
+ * \param p The display pixels.
+ * \param delay How long to show it for, in hundredths of a second.
+ *
+ * \return void
+ */
+void capture_hold_gif(Capture_t *capture, const uint64_t p[DISPLAY_H], uint64_t delay) {
+	for (; delay > UINT16_MAX; delay -= 0x8000)
+		capture_write_gif(capture, p, 0x8000);
+	capture_write_gif(capture, p, delay);
+}
+
+/**
+ * The capture writer thread: expands, scales and encodes queued frames.
+ *
+ * \param arg The Capture_t.
+ *
+ * \return void * NULL.
+ */
+void *capture_writer(void *arg) {
+	Capture_t *capture = arg;
+
+	Capture_Frame_t previous;
+	bool pending = false;
+
+	/** GIF centiseconds written, delays are kept exact by working from absolute times */
+	uint64_t written = 0;
+
+	while (true) {
+		uint64_t tail = atomic_load_explicit(&capture->tail, memory_order_relaxed);
+
+		if (tail == atomic_load_explicit(&capture->head, memory_order_acquire)) {
+			if (atomic_load(&capture->done) && tail == atomic_load(&capture->head))
+				break;
+			struct timespec wait = { .tv_nsec = 1000000 };
+			nanosleep(&wait, NULL);
+			continue;
+		}
+
+		Capture_Frame_t frame = capture->frames[tail % CAPTURE_QUEUE];
+		atomic_store_explicit(&capture->tail, tail + 1, memory_order_release);
+
+		/** The previous frame lasted until this one */
+		if (pending) {
+			if (capture->gif) {
+				/** Viewers clamp delays under 2cs, show shorter frames merged into the next one */
+				uint64_t until = frame.frame * 100 / 60;
+				if (until - written < 2) {
+					memcpy(previous.p, frame.p, sizeof(previous.p));
+					continue;
+				}
+				capture_hold_gif(capture, previous.p, until - written);
+				written = until;
+			} else {
+				for (uint64_t f = previous.frame; f < frame.frame; f++)
+					capture_write_y4m(capture, previous.p);
+			}
+		} else {
+			written = frame.frame * 100 / 60;
+		}
+		previous = frame;
+		pending = true;
+	}
+
+	/** The last frame lasted until the capture ended */
+	if (pending) {
+		uint64_t end = capture->end > previous.frame ? capture->end : previous.frame + 1;
+		if (capture->gif) {
+			uint64_t until = end * 100 / 60;
+			capture_hold_gif(capture, previous.p, until - written < 2 ? 2 : until - written);
+		} else {
+			for (uint64_t f = previous.frame; f < end; f++)
+				capture_write_y4m(capture, previous.p);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Start capturing video.
+ *
+ * \param path The file to write, animated GIF if it ends in `.gif`, Y4M otherwise.
+ * \param scale Output pixels per display pixel.
+ *
+ * \return Capture_t * The capture, NULL on failure.
+ */
+Capture_t *capture_open(const char *path, int scale) {
+	FILE *out = fopen(path, "wb");
+	if (!out) {
+		fprintf(stderr, "Can't write to %s.\n", path);
+		return NULL;
+	}
+
+	Capture_t *capture = calloc(1, sizeof(Capture_t));
+	capture->out = out;
+	capture->scale = scale < 1 ? 1 : scale;
+	atomic_init(&capture->head, 0);
+	atomic_init(&capture->tail, 0);
+	atomic_init(&capture->done, false);
+
+	const char *extension = strrchr(path, '.');
+	capture->gif = extension && !strcmp(extension, ".gif");
+
+	int w = DISPLAY_W * capture->scale;
+	int h = DISPLAY_H * capture->scale;
+
+	if (capture->gif) {
+		/** Header, logical screen with a black and white palette, loop forever */
+		fwrite("GIF89a", 1, 6, out);
+		fputc(w & 0xff, out);
+		fputc(w >> 8, out);
+		fputc(h & 0xff, out);
+		fputc(h >> 8, out);
+		fwrite("\x80\x00\x00", 1, 3, out);
+		fwrite("\x00\x00\x00\xff\xff\xff", 1, 6, out);
+		fwrite("\x21\xff\x0bNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, out);
+	} else {
+		fprintf(out, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", w, h);
+	}
+
+	pthread_create(&capture->writer, NULL, capture_writer, capture);
+
+	return capture;
+}
+
+/**
+ * Finish writing queued frames and close a capture.
+ *
+ * \param capture The capture.
+ * \param end The emulated frame the capture ended at.
+ *
+ * \return void
+ */
+void capture_close(Capture_t *capture, uint64_t end) {
+	capture->end = end;
+	atomic_store(&capture->done, true);
+	pthread_join(capture->writer, NULL);
+
+	if (capture->gif)
+		fputc(0x3b, capture->out);
+	fclose(capture->out);
+
+	if (capture->dropped)
+		fprintf(stderr, "Capture dropped %" PRIu64 " frames.\n", capture->dropped);
+
+	free(capture);
+}
+
+/**
+ * Fetch and execute one instruction, ticking the timers once a frame.
+ *
+ * \param cpu The CPU.
+ *
+ * \return void
+ */
+void cpu_cycle(CPU_t *cpu) {
+	if (cpu->pc > RAM_SIZE - INSTRUCTION_LENGTH) {
+		cpu_fault(cpu, "Segmentation fault", 0);
+	} else {
+#ifdef AOT_ROM
+		if (!aot_execute(cpu))
+#endif
+		{
+			/** Read watchpoints fire on fetches, which only RAM does */
+			c8_instruction_t instruction = cpu->decoded && !debugger.armed ? cpu->decoded[cpu->pc] : 0;
+			cpu_execute(cpu, instruction ? instruction : ram_get_instruction(cpu->ram, cpu->pc));
+		}
+	}
+
+	if (cpu->flags.SPECULATIVE)
+		telemetry.speculative++;
+	else
+		telemetry.instructions++;
+
+	if ((++cpu->cycles % CYCLES_PER_FRAME) == 0) {
+		cpu_timer_tick(cpu);
+
+		if (cpu->display && cpu->display->capture && !cpu->flags.SPECULATIVE)
+			capture_push(cpu->display->capture, cpu->display->p, cpu->cycles / CYCLES_PER_FRAME);
+	}
+}
+
+/**
+ * A copy of the whole machine state.
+ */
+typedef struct {
+	/**
+	 * The CPU.
+	 */
+	CPU_t cpu;
+
+	/**
+	 * The RAM.
+	 */
+	uint8_t ram[RAM_SIZE];
+
+	/**
+	 * The display pixels.
+	 */
+	uint64_t p[DISPLAY_H];
+} Snapshot_t;
+
+/**
+ * Capture the state of a machine.
+ *
+ * \param snapshot The snapshot to write to.
+ * \param cpu The CPU, with its RAM and display.
+ *
+ * \return void
+ */
+void snapshot_save(Snapshot_t *snapshot, CPU_t *cpu) {
+	snapshot->cpu = *cpu;
+	memcpy(snapshot->ram, cpu->ram, RAM_SIZE);
+	memcpy(snapshot->p, cpu->display->p, sizeof(snapshot->p));
+}
+
+/**
+ * Restore the state of a machine.
+ *
+ * The CPU keeps its own RAM and display, their contents are overwritten.
+ *
+ * \param snapshot The snapshot to restore.
+ * \param cpu The CPU to restore into.
+ *
+ * \return void
+ */
+void snapshot_restore(Snapshot_t *snapshot, CPU_t *cpu) {
+	RAM_t ram = cpu->ram;
+	Display_t *display = cpu->display;
+
+	*cpu = snapshot->cpu;
+	cpu->ram = ram;
+	cpu->display = display;
+
+	memcpy(cpu->ram, snapshot->ram, RAM_SIZE);
+	memcpy(cpu->display->p, snapshot->p, sizeof(snapshot->p));
+}
+
+/**
+ * Hash the observable state of a machine: the display and the registers.
+ *
+ * \param cpu The CPU, with its display.
+ *
+ * \return uint64_t The hash.
+ */
+uint64_t cpu_hash(CPU_t *cpu) {
+	uint64_t hash = FNV_OFFSET;
+	hash = fnv1a(hash, cpu->display->p, sizeof(cpu->display->p));
+	hash = fnv1a(hash, cpu->v, sizeof(cpu->v));
+	hash = fnv1a(hash, &cpu->i, sizeof(cpu->i));
+	hash = fnv1a(hash, &cpu->pc, sizeof(cpu->pc));
+	hash = fnv1a(hash, &cpu->sp, sizeof(cpu->sp));
+	hash = fnv1a(hash, &cpu->delay, sizeof(cpu->delay));
+	hash = fnv1a(hash, &cpu->sound, sizeof(cpu->sound));
+	return hash;
+}
+
+/**
+ * Write a histogram as a JSON object.
+ *
+ * \param histogram The histogram.
+ * \param out The file to write to.
+ *
+ * \return void
+ */
+void histogram_dump_json(Histogram_t *histogram, FILE *out) {
+	fprintf(out, "{\"count\": %" PRIu64 ", \"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 ", \"buckets\": [",
+		histogram->total, histogram_percentile(histogram, 50), histogram_percentile(histogram, 99), histogram->max);
+
+	bool first = true;
+	for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+		if (!histogram->counts[bucket])
+			continue;
+		fprintf(out, "%s[%" PRIu64 ", %" PRIu64 "]", first ? "" : ", ", histogram_bucket_floor(bucket), histogram->counts[bucket]);
+		first = false;
+	}
+	fprintf(out, "]}");
+}
+
+/**
+ * Write this thread's telemetry as a line of JSON.
+ *
+ * \param out The file to write to.
+ *
+ * \return void
+ */
+void telemetry_dump_json(FILE *out) {
+	fprintf(out, "{\"time_ns\": %" PRIu64 ", \"instructions\": %" PRIu64 ", \"speculative\": %" PRIu64 ", \"ips\": %" PRIu64
+		", \"frames\": %" PRIu64 ", \"late\": %" PRIu64 ", \"dropped\": %" PRIu64
+		", \"event_queue\": {\"depth\": %" PRIu64 ", \"max\": %" PRIu64 "}, \"frame_time_ns\": ",
+		clock_ns(), telemetry.instructions, telemetry.speculative, telemetry.ips, telemetry.frames, telemetry.late, telemetry.dropped,
+		telemetry.events, telemetry.max_events);
+	histogram_dump_json(&telemetry.frame_time, out);
+	fprintf(out, ", \"present_time_ns\": ");
+	histogram_dump_json(&telemetry.present_time, out);
+	fprintf(out, "}\n");
+}
+
+/**
+ * Send this thread's telemetry to a collector.
+ *
+ * Never blocks: a collector that isn't listening just misses the update.
+ *
+ * \param sink A file to append to, or `unix:/path` for a datagram socket.
+ *
+ * \return void
+ */
+void telemetry_send(const char *sink) {
+	if (strncmp(sink, "unix:", 5)) {
+		FILE *out = fopen(sink, "a");
+		if (out) {
+			telemetry_dump_json(out);
+			fclose(out);
+		}
+		return;
+	}
+
+	char *json = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&json, &size);
+	telemetry_dump_json(out);
+	fclose(out);
+
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	strncpy(address.sun_path, sink + 5, sizeof(address.sun_path) - 1);
+
+	int s = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (s >= 0) {
+		sendto(s, json, size, MSG_DONTWAIT, (struct sockaddr *)&address, sizeof(address));
+		close(s);
+	}
+	free(json);
+}
+
+/**
+ * A ROM regression run.
+ */
+typedef struct {
+	/**
+	 * The ROM file.
+	 */
+	char rom[PATH_MAX];
+
+	/**
+	 * Frames to run for.
+	 */
+	uint64_t frames;
+
+	/**
+	 * Hash every this many frames.
+	 */
+	uint64_t checkpoint;
+
+	/**
+	 * Record new golden hashes instead of comparing.
+	 */
+	bool update;
+
+	/**
+	 * Only run, neither compare nor record golden hashes.
+	 */
+	bool dry;
+
+	/**
+	 * Capture video to the ROM file name with this suffix, if set.
+	 */
+	char capture[16];
+
+	/**
+	 * Golden hashes recorded.
+	 */
+	bool recorded;
+
+	/**
+	 * Why the ROM couldn't be run, if it couldn't.
+	 */
+	const char *error;
+
+	/**
+	 * The number of checkpoints that didn't match.
+	 */
+	int mismatches;
+
+	/**
+	 * The first frame that didn't match.
+	 */
+	uint64_t first_mismatch;
+
+	/**
+	 * How long the emulation took.
+	 */
+	double milliseconds;
+} Regression_t;
+
+/**
+ * Run a ROM headless and compare its checkpoints against the golden file,
+ * or record it.
+ *
+ * The input script, `ROM.input`, has a `frame keys` line per input change,
+ * both numbers in hex, the keys as a bitmask like CPU_t.input. The golden
+ * file, `ROM.golden`, has a `frame hash` line per checkpoint.
+ *
+ * \param regression The run.
+ *
+ * \return void
+ */
+void regression_run(Regression_t *regression) {
+	char path[PATH_MAX + sizeof(regression->capture)];
+
+	uint8_t _ram[RAM_SIZE] = { 0 };
+	RAM_t ram = _ram;
+
+	uint8_t image[RAM_SIZE - ROM_OFFSET];
+	size_t size;
+	if ((regression->error = ram_read_rom(regression->rom, image, &size)))
+		return;
+	memcpy(ram + ROM_OFFSET, image, size);
+	ram_load_digit_sprites(ram, BUILTIN_SPRITES_OFFSET);
+
+	Display_t display = { .renderer = NULL, .capture = NULL };
+	display_clear(&display);
+
+	if (regression->capture[0]) {
+		snprintf(path, sizeof(path), "%s%s", regression->rom, regression->capture);
+		display.capture = capture_open(path, getenv("CAPTURE_SCALE") ? atoi(getenv("CAPTURE_SCALE")) : 4);
+	}
+
+	CPU_t cpu;
+	cpu_reset(&cpu);
+	cpu.ram = ram;
+	cpu.display = &display;
+	cpu.seed = ROM_OFFSET; /** Deterministic */
+	cpu.flags.MUTE = 1;
+
+	snprintf(path, sizeof(path), "%s.input", regression->rom);
+	FILE *input = fopen(path, "r");
+	uint64_t input_frame = 0;
+	unsigned int input_keys = 0;
+	bool input_pending = input && fscanf(input, "%" SCNx64 " %x", &input_frame, &input_keys) == 2;
+
+	uint64_t checkpoints = regression->frames / regression->checkpoint + 1;
+	uint64_t *hashes = calloc(checkpoints, sizeof(uint64_t));
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (uint64_t frame = 0, checkpoint = 0; frame <= regression->frames; frame++) {
+		while (input_pending && input_frame <= frame) {
+			cpu.input = input_keys;
+			input_pending = fscanf(input, "%" SCNx64 " %x", &input_frame, &input_keys) == 2;
+		}
+
+		if (frame % regression->checkpoint == 0) {
+			hashes[checkpoint++] = cpu_hash(&cpu);
+		}
+
+		for (int c = 0; c < CYCLES_PER_FRAME && !cpu.flags.HALT; c++) {
+			cpu_cycle(&cpu);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	regression->milliseconds = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+	if (input)
+		fclose(input);
+	if (display.capture)
+		capture_close(display.capture, cpu.cycles / CYCLES_PER_FRAME);
+
+	if (regression->dry) {
+		free(hashes);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s.golden", regression->rom);
+	FILE *golden = fopen(path, regression->update ? "w" : "r");
+	if (!golden) {
+		regression->error = regression->update ? "can't write golden" : "no golden, record with REGRESS_UPDATE=1";
+	} else if (regression->update) {
+		for (uint64_t checkpoint = 0; checkpoint < checkpoints; checkpoint++) {
+			fprintf(golden, "%" PRIx64 " %016" PRIx64 "\n", checkpoint * regression->checkpoint, hashes[checkpoint]);
+		}
+		regression->recorded = true;
+	} else {
+		uint64_t frame, hash;
+		for (uint64_t checkpoint = 0; checkpoint < checkpoints; checkpoint++) {
+			if (fscanf(golden, "%" SCNx64 " %" SCNx64, &frame, &hash) != 2
+					|| frame != checkpoint * regression->checkpoint || hash != hashes[checkpoint]) {
+				if (!regression->mismatches++)
+					regression->first_mismatch = checkpoint * regression->checkpoint;
+			}
+		}
+
+		/** A golden from a longer run doesn't match a shorter one */
+		if (fscanf(golden, "%" SCNx64 " %" SCNx64, &frame, &hash) != EOF) {
+			if (!regression->mismatches++)
+				regression->first_mismatch = checkpoints * regression->checkpoint;
+		}
+	}
+
+	if (golden)
+		fclose(golden);
+	free(hashes);
+}
+
+/**
+ * The shared state of the regression thread pool.
+ */
+typedef struct {
+	/**
+	 * All the runs.
+	 */
+	Regression_t *regressions;
+
+	/**
+	 * The number of runs.
+	 */
+	int count;
+
+	/**
+	 * The next run to pick up.
+	 */
+	atomic_int next;
+} Regression_Pool_t;
+
+/**
+ * A regression thread pool worker.
+ *
+ * \param arg The Regression_Pool_t.
+ *
+ * \return void * NULL.
+ */
+void *regression_worker(void *arg) {
+	Regression_Pool_t *pool = arg;
+	int r;
+	while ((r = atomic_fetch_add(&pool->next, 1)) < pool->count) {
+		regression_run(&pool->regressions[r]);
+	}
+	return NULL;
+}
+
+/**
+ * Run all the ROMs in a directory against their golden files.
+ *
+ * Configured through the environment: FRAMES to run for (600),
+ * CHECKPOINT to hash every (60 frames), THREADS (one per CPU),
+ * REGRESS_UPDATE to record the golden files, REGRESS_DRY to only run
+ * the ROMs, say for profiling, and CAPTURE, a suffix like `.gif` to record
+ * video next to each ROM.
+ *
+ * \param directory The directory with the ROMs.
+ *
+ * \return int Program exit code, non-zero if anything failed.
+ */
+int regress(const char *directory) {
+	DIR *dir = opendir(directory);
+	if (!dir) {
+		fprintf(stderr, "Can't open %s.\n", directory);
+		return -1;
+	}
+
+	Regression_Pool_t pool = { .regressions = NULL, .count = 0 };
+	atomic_init(&pool.next, 0);
+
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		const char *extension = strrchr(entry->d_name, '.');
+		if (entry->d_name[0] == '.' || (extension && (!strcmp(extension, ".input") || !strcmp(extension, ".golden")
+				|| !strcmp(extension, ".y4m") || !strcmp(extension, ".gif"))))
+			continue;
+
+		pool.regressions = realloc(pool.regressions, (pool.count + 1) * sizeof(Regression_t));
+		Regression_t *regression = &pool.regressions[pool.count++];
+		memset(regression, 0, sizeof(Regression_t));
+		snprintf(regression->rom, sizeof(regression->rom), "%s/%s", directory, entry->d_name);
+		regression->frames = getenv("FRAMES") ? strtoull(getenv("FRAMES"), NULL, 10) : 600;
+		regression->checkpoint = getenv("CHECKPOINT") ? strtoull(getenv("CHECKPOINT"), NULL, 10) : 60;
+		regression->checkpoint = regression->checkpoint ? regression->checkpoint : 1;
+		regression->update = getenv("REGRESS_UPDATE");
+		regression->dry = getenv("REGRESS_DRY");
+		snprintf(regression->capture, sizeof(regression->capture), "%s", getenv("CAPTURE") ? getenv("CAPTURE") : "");
+	}
+	closedir(dir);
+
+	if (!pool.count) {
+		fprintf(stderr, "No ROMs in %s.\n", directory);
+		return -1;
+	}
+
+	long threads = getenv("THREADS") ? atol(getenv("THREADS")) : sysconf(_SC_NPROCESSORS_ONLN);
+	threads = threads < 1 ? 1 : threads > pool.count ? pool.count : threads;
+
+	pthread_t workers[threads];
+	for (int t = 0; t < threads; t++)
+		pthread_create(&workers[t], NULL, regression_worker, &pool);
+	for (int t = 0; t < threads; t++)
+		pthread_join(workers[t], NULL);
+
+	int failed = 0;
+	double total = 0;
+	for (int r = 0; r < pool.count; r++) {
+		Regression_t *regression = &pool.regressions[r];
+		total += regression->milliseconds;
+
+		if (regression->error) {
+			printf("ERROR %9.2f ms  %s (%s)\n", regression->milliseconds, regression->rom, regression->error);
+			failed++;
+		} else if (regression->mismatches) {
+			printf("FAIL  %9.2f ms  %s (%d mismatches, first at frame %" PRIu64 ")\n",
+				regression->milliseconds, regression->rom, regression->mismatches, regression->first_mismatch);
+			failed++;
+		} else {
+			printf("%s %9.2f ms  %s\n", regression->dry ? "RAN  " : regression->recorded ? "NEW  " : "PASS ",
+				regression->milliseconds, regression->rom);
+		}
+	}
+	printf("\n%d ROMs: %d passed, %d failed, %.2f ms emulating on %ld threads\n",
+		pool.count, pool.count - failed, failed, total, threads);
+
+	free(pool.regressions);
+
+	return failed ? 1 : 0;
+}
+
+/**
+ * A microbenchmark.
+ */
+typedef struct {
+	/**
+	 * What's measured.
+	 */
+	const char *name;
+
+	/**
+	 * The instruction for cpu_execute benchmarks, 0 for the others.
+	 */
+	c8_instruction_t instruction;
+
+	/**
+	 * One iteration, given the CPU, the instruction and the iteration number.
+	 */
+	void (*run)(CPU_t *cpu, c8_instruction_t instruction, uint64_t n);
+} Benchmark_t;
+
+/**
+ * Keep the compiler from optimizing across benchmark iterations.
+ */
+#define BENCH_BARRIER() __asm__ volatile("" ::: "memory")
+
+/**
+ * Nothing, to measure the benchmark loop itself.
+ *
+ * \param cpu A CPU with RAM and a headless display.
+ * \param instruction Unused.
+ * \param n Unused.
+ *
+ * \return void
+ */
+void bench_empty(CPU_t *cpu, c8_instruction_t instruction, uint64_t n) {
+}
+
+/**
+ * Execute an instruction from the same state every time, with a return
+ * address on the stack for 00EE.
+ *
+ * \param cpu A CPU with RAM and a headless display.
+ * \param instruction The instruction to execute.
+ * \param n Unused.
+ *
+ * \return void
+ */
+void bench_execute(CPU_t *cpu, c8_instruction_t instruction, uint64_t n) {
+	cpu->pc = ROM_OFFSET;
+	cpu->stack[0] = ROM_OFFSET;
+	cpu->sp = 1;
+	cpu->i = 0x300;
+	cpu_execute(cpu, instruction);
+}
+
+/**
+ * Draw a row of pixels all over the display.
+ *
+ * \param cpu A CPU with RAM and a headless display.
+ * \param instruction Unused.
+ * \param n The iteration, picks the row and where it's drawn.
+ *
+ * \return void
+ */
+void bench_draw_row(CPU_t *cpu, c8_instruction_t instruction, uint64_t n) {
+	display_draw_row(cpu->display, n, n % DISPLAY_W, n % DISPLAY_H);
+}
+
+/**
+ * Fetch an instruction.
+ *
+ * \param cpu A CPU with RAM and a headless display.
+ * \param instruction Unused.
+ * \param n The iteration, picks the address.
+ *
+ * \return void
+ */
+void bench_fetch(CPU_t *cpu, c8_instruction_t instruction, uint64_t n) {
+	cpu->v[0] += ram_get_instruction(cpu->ram, ROM_OFFSET + (n & 0xfe));
+}
+
+/**
+ * Tick running timers.
+ *
+ * \param cpu A CPU with RAM and a headless display.
+ * \param instruction Unused.
+ * \param n Unused.
+ *
+ * \return void
+ */
+void bench_timer_tick(CPU_t *cpu, c8_instruction_t instruction, uint64_t n) {
+	cpu->delay = cpu->sound = 2;
+	cpu_timer_tick(cpu);
+}
+
+/**
+ * Poll the keyboard state.
+ *
+ * \param cpu A CPU with RAM and a headless display.
+ * \param instruction Unused.
+ * \param n Unused.
+ *
+ * \return void
+ */
+void bench_poll_keys(CPU_t *cpu, c8_instruction_t instruction, uint64_t n) {
+	static const uint8_t keys[SDL_NUM_SCANCODES] = { [SDL_SCANCODE_X] = 1 };
+	cpu_poll_keystate(cpu, keys);
+}
+
+/**
+ * A whole fetch and execute cycle.
+ *
+ * \param cpu A CPU with RAM and a headless display.
+ * \param instruction Unused.
+ * \param n Unused.
+ *
+ * \return void
+ */
+void bench_cycle(CPU_t *cpu, c8_instruction_t instruction, uint64_t n) {
+	cpu->pc = ROM_OFFSET;
+	cpu_cycle(cpu);
+}
+
+/**
+ * Time one repetition of a benchmark.
+ *
+ * \param benchmark The benchmark.
+ * \param cpu A CPU with RAM and a headless display.
+ * \param iterations How many times to run it.
+ *
+ * \return double Nanoseconds per iteration.
+ */
+double bench_run(const Benchmark_t *benchmark, CPU_t *cpu, uint64_t iterations) {
+	/** Resolved up front, every benchmark pays for the same indirect call */
+	void (*run)(CPU_t *, c8_instruction_t, uint64_t) = benchmark->run;
+	c8_instruction_t instruction = benchmark->instruction;
+
+	uint64_t start = clock_ns();
+
+	for (uint64_t n = 0; n < iterations; n++) {
+		run(cpu, instruction, n);
+		BENCH_BARRIER();
+	}
+
+	return (double)(clock_ns() - start) / iterations;
+}
+
+/**
+ * Compare doubles for qsort.
+ *
+ * \param a The first double.
+ * \param b The second double.
+ *
+ * \return int Negative, zero or positive as a is less, equal or greater.
+ */
+int bench_compare(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * The median of some samples, sorts them.
+ *
+ * \param samples The samples.
+ * \param count How many.
+ *
+ * \return double The median.
+ */
+double bench_median(double *samples, int count) {
+	qsort(samples, count, sizeof(double), bench_compare);
+	return count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+}
+
+/**
+ * Run the microbenchmarks.
+ *
+ * Each benchmark is repeated BENCH_REPS (25) times over BENCH_ITERATIONS
+ * (100000) iterations and reported as the median with its median absolute
+ * deviation, less the median of an empty benchmark. With BENCH_BASELINE,
+ * a benchmark regresses when its median is more than BENCH_THRESHOLD (10)
+ * percent and 3 deviations slower than the baseline. BENCH_SAVE writes the
+ * medians for use as a baseline.
  *
- * \return void
+ * \return int Program exit code, non-zero if anything regressed.
  */
-void cpu_poll_keystate(CPU_t *cpu, const uint8_t *keys) {
-	/** Setup keypresses */
-	cpu->input = ( 0
-		/** Map your own keys https://wiki.libsdl.org/SDL_Scancode */
-		| ((keys[SDL_SCANCODE_Z]) ? 1 << 0x0 : 0)
-		| ((keys[SDL_SCANCODE_X]) ? 1 << 0x1 : 0)
-		| ((keys[SDL_SCANCODE_C]) ? 1 << 0x2 : 0)
-		| ((keys[SDL_SCANCODE_V]) ? 1 << 0x3 : 0)
-		| ((keys[SDL_SCANCODE_A]) ? 1 << 0x4 : 0)
-		| ((keys[SDL_SCANCODE_S]) ? 1 << 0x5 : 0)
-		| ((keys[SDL_SCANCODE_D]) ? 1 << 0x6 : 0)
-		| ((keys[SDL_SCANCODE_F]) ? 1 << 0x7 : 0)
-		| ((keys[SDL_SCANCODE_Q]) ? 1 << 0x8 : 0)
-		| ((keys[SDL_SCANCODE_W]) ? 1 << 0x9 : 0)
-		| ((keys[SDL_SCANCODE_E]) ? 1 << 0xa : 0)
-		| ((keys[SDL_SCANCODE_R]) ? 1 << 0xb : 0)
-		| ((keys[SDL_SCANCODE_1]) ? 1 << 0xc : 0)
-		| ((keys[SDL_SCANCODE_2]) ? 1 << 0xd : 0)
-		| ((keys[SDL_SCANCODE_3]) ? 1 << 0xe : 0)
-		| ((keys[SDL_SCANCODE_4]) ? 1 << 0xf : 0)
-	);
+int bench(void) {
+	static const Benchmark_t benchmarks[] = {
+		{ "00E0", 0x00e0, bench_execute }, { "00EE", 0x00ee, bench_execute }, { "1NNN", 0x1200, bench_execute },
+		{ "2NNN", 0x2200, bench_execute }, { "3XNN", 0x3000, bench_execute }, { "4XNN", 0x4000, bench_execute },
+		{ "5XY0", 0x5010, bench_execute }, { "6XNN", 0x6012, bench_execute }, { "7XNN", 0x7001, bench_execute },
+		{ "8XY0", 0x8010, bench_execute }, { "8XY1", 0x8011, bench_execute }, { "8XY2", 0x8012, bench_execute },
+		{ "8XY3", 0x8013, bench_execute }, { "8XY4", 0x8014, bench_execute }, { "8XY5", 0x8015, bench_execute },
+		{ "8XY6", 0x8016, bench_execute }, { "8XY7", 0x8017, bench_execute }, { "8XYE", 0x801e, bench_execute },
+		{ "9XY0", 0x9010, bench_execute }, { "ANNN", 0xa300, bench_execute }, { "CXNN", 0xc0ff, bench_execute },
+		{ "DXYN", 0xd01f, bench_execute }, { "EX9E", 0xe09e, bench_execute }, { "EXA1", 0xe0a1, bench_execute },
+		{ "FX07", 0xf007, bench_execute }, { "FX0A", 0xf00a, bench_execute }, { "FX15", 0xf015, bench_execute },
+		{ "FX18", 0xf018, bench_execute }, { "FX1E", 0xf01e, bench_execute }, { "FX29", 0xf029, bench_execute },
+		{ "FX33", 0xf033, bench_execute }, { "FX55", 0xf555, bench_execute }, { "FX65", 0xf565, bench_execute },
+		{ "draw_row", 0, bench_draw_row }, { "fetch", 0, bench_fetch }, { "timer_tick", 0, bench_timer_tick },
+		{ "poll_keys", 0, bench_poll_keys }, { "cycle", 0, bench_cycle },
+	};
+	static const Benchmark_t empty = { "empty", 0, bench_empty };
+
+	int reps = getenv("BENCH_REPS") ? atoi(getenv("BENCH_REPS")) : 25;
+	uint64_t iterations = getenv("BENCH_ITERATIONS") ? strtoull(getenv("BENCH_ITERATIONS"), NULL, 10) : 100000;
+	double threshold = (getenv("BENCH_THRESHOLD") ? atof(getenv("BENCH_THRESHOLD")) : 10) / 100;
+	reps = reps < 1 ? 1 : reps;
+	iterations = iterations ? iterations : 1;
+
+	FILE *baseline = getenv("BENCH_BASELINE") ? fopen(getenv("BENCH_BASELINE"), "r") : NULL;
+	FILE *save = getenv("BENCH_SAVE") ? fopen(getenv("BENCH_SAVE"), "w") : NULL;
+
+	uint8_t _ram[RAM_SIZE] = { 0 };
+	RAM_t ram = _ram;
+	ram_load_digit_sprites(ram, BUILTIN_SPRITES_OFFSET);
+	for (int b = ROM_OFFSET; b < RAM_SIZE; b += INSTRUCTION_LENGTH) {
+		/** Something to fetch, execute and draw */
+		ram[b] = 0x60;
+		ram[b + 1] = b;
+	}
+
+	Display_t display = { .renderer = NULL, .capture = NULL };
+	display_clear(&display);
+
+	CPU_t cpu;
+	cpu_reset(&cpu);
+	cpu.ram = ram;
+	cpu.display = &display;
+	cpu.input = 0x1;
+	cpu.seed = 1;
+	cpu.flags.MUTE = 1;
+
+	printf("%-12s %10s %10s %10s\n", "benchmark", "median ns", "MAD ns", "baseline");
+
+	int regressed = 0;
+	double samples[reps];
+	double deviations[reps];
+
+	/** The loop and call overhead, taken off every benchmark */
+	bench_run(&empty, &cpu, iterations / 10 + 1);
+	for (int r = 0; r < reps; r++)
+		samples[r] = bench_run(&empty, &cpu, iterations);
+	double overhead = bench_median(samples, reps);
+	printf("%-12s %10.2f\n", "(overhead)", overhead);
+
+	for (int b = 0; b < NELEMS(benchmarks); b++) {
+		cpu.delay = cpu.sound = 0;
+
+		/** Warm up */
+		bench_run(&benchmarks[b], &cpu, iterations / 10 + 1);
+
+		for (int r = 0; r < reps; r++) {
+			samples[r] = bench_run(&benchmarks[b], &cpu, iterations) - overhead;
+			samples[r] = samples[r] < 0 ? 0 : samples[r];
+		}
+		double median = bench_median(samples, reps);
+		for (int r = 0; r < reps; r++)
+			deviations[r] = samples[r] > median ? samples[r] - median : median - samples[r];
+		double mad = bench_median(deviations, reps);
+
+		printf("%-12s %10.2f %10.2f", benchmarks[b].name, median, mad);
+
+		char name[16];
+		double expected;
+		if (baseline) {
+			rewind(baseline);
+			while (fscanf(baseline, "%15s %lf", name, &expected) == 2) {
+				if (strcmp(name, benchmarks[b].name))
+					continue;
+				bool regression = median > expected * (1 + threshold) && median - expected > 3 * mad;
+				printf(" %10.2f %+6.1f%%%s", expected, (median - expected) / expected * 100, regression ? " REGRESSED" : "");
+				regressed += regression;
+				break;
+			}
+		}
+		printf("\n");
+
+		if (save)
+			fprintf(save, "%s %.3f\n", benchmarks[b].name, median);
+	}
+
+	if (baseline)
+		fclose(baseline);
+	if (save)
+		fclose(save);
+
+	if (regressed)
+		printf("\n%d benchmarks regressed\n", regressed);
+
+	return regressed ? 1 : 0;
+}
+
+/**
+ * A machine for fuzzing, reset from a snapshot between runs.
+ */
+typedef struct {
+	/**
+	 * The RAM.
+	 */
+	uint8_t ram[RAM_SIZE];
+
+	/**
+	 * The headless display.
+	 */
+	Display_t display;
+
+	/**
+	 * The CPU.
+	 */
+	CPU_t cpu;
+
+	/**
+	 * The freshly reset machine.
+	 */
+	Snapshot_t pristine;
+
+	/**
+	 * The pristine snapshot has been taken.
+	 */
+	bool ready;
+} Fuzz_t;
+
+/**
+ * Run one fuzzing input.
+ *
+ * The input starts with FUZZ_FRAMES 16-bit little-endian key masks, cycled
+ * through once a frame, followed by the ROM. It runs for FUZZ_CYCLES
+ * instructions or until the CPU halts.
+ *
+ * \param data The input.
+ * \param size The size of the input.
+ *
+ * \return const char * The guest fault, NULL if none.
+ */
+const char *fuzz_one(const uint8_t *data, size_t size) {
+	static _Thread_local Fuzz_t fuzz;
+
+	if (!fuzz.ready) {
+		memset(fuzz.ram, 0, sizeof(fuzz.ram));
+		ram_load_digit_sprites(fuzz.ram, BUILTIN_SPRITES_OFFSET);
+		fuzz.display.renderer = NULL;
+		fuzz.display.capture = NULL;
+		display_clear(&fuzz.display);
+		cpu_reset(&fuzz.cpu);
+		fuzz.cpu.ram = fuzz.ram;
+		fuzz.cpu.display = &fuzz.display;
+		fuzz.cpu.seed = 1;
+		fuzz.cpu.flags.MUTE = 1;
+		snapshot_save(&fuzz.pristine, &fuzz.cpu);
+		fuzz.ready = true;
+	}
+
+	snapshot_restore(&fuzz.pristine, &fuzz.cpu);
+
+	uint16_t keys[FUZZ_FRAMES] = { 0 };
+	size_t header = size < sizeof(keys) ? size : sizeof(keys);
+	for (size_t b = 0; b < header; b++)
+		keys[b / 2] |= data[b] << (b % 2 * 8);
+
+	size_t rom = size - header;
+	memcpy(fuzz.ram + ROM_OFFSET, data + header, rom < RAM_SIZE - ROM_OFFSET ? rom : RAM_SIZE - ROM_OFFSET);
+
+	for (int c = 0; c < FUZZ_CYCLES && !fuzz.cpu.flags.HALT; c++) {
+		if (c % CYCLES_PER_FRAME == 0)
+			fuzz.cpu.input = keys[c / CYCLES_PER_FRAME % FUZZ_FRAMES];
+		cpu_cycle(&fuzz.cpu);
+	}
+
+	return fuzz.cpu.fault;
+}
+
+#ifdef FUZZING
+/**
+ * The libFuzzer entry point.
+ *
+ * \param data The input, see fuzz_one.
+ * \param size The size of the input.
+ *
+ * \return int 0, every input is kept.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	fuzz_one(data, size);
+	return 0;
+}
+#endif
+
+/**
+ * A xorshift64 pseudo-random number.
+ *
+ * \param state The generator state, not 0.
+ *
+ * \return uint64_t The next number.
+ */
+uint64_t fuzz_random(uint64_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+/**
+ * A random instruction of a valid kind, jumping and pointing I into the ROM
+ * most of the time.
+ *
+ * \param state The generator state.
+ * \param size The size of the ROM.
+ *
+ * \return c8_instruction_t The instruction.
+ */
+c8_instruction_t fuzz_instruction(uint64_t *state, size_t size) {
+	static const uint8_t alu[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xe };
+	static const uint8_t misc[] = { 0x07, 0x0a, 0x15, 0x18, 0x1e, 0x29, 0x33, 0x55, 0x65 };
+
+	uint64_t random = fuzz_random(state);
+	uint8_t family = random & 0xf;
+	uint16_t x = random >> 8 & 0xf, y = random >> 12 & 0xf, nn = random >> 16 & 0xff;
+	uint16_t address = random >> 24 & 0xf ? (ROM_OFFSET + (random >> 32) % (size ? size : 1)) & ~1 : random >> 32 & 0xfff;
+
+	switch (family) {
+		case 0x0:
+			return random >> 48 & 0x3 ? 0x00e0 : 0x00ee;
+		case 0x1:
+		case 0x2:
+			return family << 12 | address;
+		case 0xb:
+			/** Not implemented by the interpreter, jump instead */
+			return 0x1000 | address;
+		case 0xa:
+			/** Mostly past the ROM, writes through I would overwrite code otherwise */
+			return 0xa000 | (random >> 24 & 0x3 ? 0xf00 : address);
+		case 0x5:
+		case 0x9:
+			return family << 12 | x << 8 | y << 4;
+		case 0x8:
+			return 0x8000 | x << 8 | y << 4 | alu[(random >> 48) % NELEMS(alu)];
+		case 0xd:
+			return 0xd000 | x << 8 | y << 4 | (random >> 48 & 0xf);
+		case 0xe:
+			return 0xe000 | x << 8 | (random >> 48 & 0x1 ? 0x9e : 0xa1);
+		case 0xf:
+			return 0xf000 | x << 8 | misc[(random >> 48) % NELEMS(misc)];
+		default:
+			return family << 12 | x << 8 | nn;
+	}
+}
+
+/**
+ * Fuzz with random inputs, without libFuzzer.
+ *
+ * Most ROMs are made of valid instructions so that runs get past the first
+ * few, the rest are random bytes.
+ *
+ * \param iterations How many inputs to run.
+ *
+ * \return int Program exit code.
+ */
+int fuzz(uint64_t iterations) {
+	uint8_t data[FUZZ_FRAMES * 2 + RAM_SIZE - ROM_OFFSET];
+	uint64_t state = getenv("FUZZ_SEED") ? strtoull(getenv("FUZZ_SEED"), NULL, 0) : time(NULL);
+	state = state ? state : 1;
+
+	const char *faults[8] = { NULL };
+	uint64_t counts[NELEMS(faults)] = { 0 };
+
+	uint64_t start = clock_ns();
+	uint64_t instructions = telemetry.instructions;
+	for (uint64_t n = 0; n < iterations; n++) {
+		size_t size = fuzz_random(&state) % (sizeof(data) + 1);
+		for (size_t b = 0; b < size; b += sizeof(state)) {
+			uint64_t random = fuzz_random(&state);
+			memcpy(data + b, &random, sizeof(random) < size - b ? sizeof(random) : size - b);
+		}
+
+		if (fuzz_random(&state) % 8 && size > FUZZ_FRAMES * 2) {
+			for (size_t b = FUZZ_FRAMES * 2; b + 1 < size; b += INSTRUCTION_LENGTH) {
+				c8_instruction_t instruction = fuzz_instruction(&state, size - FUZZ_FRAMES * 2);
+				data[b] = instruction >> 8;
+				data[b + 1] = instruction & 0xff;
+			}
+		}
+
+		const char *fault = fuzz_one(data, size);
+		for (int f = 0; f < NELEMS(faults); f++) {
+			if (faults[f] == fault || !counts[f]) {
+				faults[f] = fault;
+				counts[f]++;
+				break;
+			}
+		}
+	}
+	double seconds = (clock_ns() - start) / 1e9;
+	instructions = telemetry.instructions - instructions;
+
+	printf("%" PRIu64 " runs in %.2f s, %.0f runs/s, %.0f instructions/s, %.1f instructions/run\n",
+		iterations, seconds, iterations / seconds, instructions / seconds, (double)instructions / iterations);
+	for (int f = 0; f < NELEMS(faults) && counts[f]; f++)
+		printf("%10" PRIu64 "  %s\n", counts[f], faults[f] ? faults[f] : "(ran to completion)");
+
+	return 0;
 }
 
 /**
@@ -612,6 +3323,7 @@ void cpu_poll_keystate(CPU_t *cpu, const uint8_t *keys) {
  */
 int test(int, char *[]);
 
+#ifndef FUZZING
 /**
  * The main function.
  *
@@ -627,27 +3339,72 @@ int main(int argc, char *argv[]) {
 		return test(argc, argv);
 	}
 
+	if (getenv("REGRESS")) {
+		return regress(getenv("REGRESS"));
+	}
+
+	if (getenv("BENCH")) {
+		return bench();
+	}
+
+	if (getenv("FUZZ")) {
+		return fuzz(strtoull(getenv("FUZZ"), NULL, 10));
+	}
+
 	if (argc < 2) {
 		fprintf(stderr, "Please supply a ROM file.\n");
 		return -1;
 	}
 
-	SDL_Init(SDL_INIT_VIDEO);
-
 	CPU_t cpu;
 	cpu_reset(&cpu);
 
 	uint8_t _ram[RAM_SIZE] = { 0 };
 	RAM_t ram = _ram;
 
-	FILE *rom = fopen(argv[1], "rb");
-	ram_load_file(ram, ROM_OFFSET, rom);
-	fclose(rom);
+	uint8_t image[RAM_SIZE - ROM_OFFSET];
+	size_t size;
+	const char *error = ram_read_rom(argv[1], image, &size);
+	if (error) {
+		fprintf(stderr, "%s %s.\n", error, argv[1]);
+		return -1;
+	}
 
+	memcpy(ram + ROM_OFFSET, image, size);
 	ram_load_digit_sprites(ram, BUILTIN_SPRITES_OFFSET);
 
+	/** Precomputed artifacts shared between instances */
+	const Cache_t *cache = getenv("CACHE") ? cache_open(getenv("CACHE"), image, size) : NULL;
+
+	if (getenv("ANALYSE") || getenv("TRANSLATE")) {
+		/** Or our own, only built when something reads it */
+		Analysis_t *built = NULL;
+		if (!cache) {
+			built = malloc(sizeof(Analysis_t));
+			analysis_build(built, ram, size);
+		}
+		const Analysis_t *analysis = cache ? &cache->analysis : built;
+
+		FILE *out = getenv("TRANSLATE") ? fopen(getenv("TRANSLATE"), "w") : stdout;
+		if (!out) {
+			fprintf(stderr, "Can't write to %s.\n", getenv("TRANSLATE"));
+		} else if (getenv("TRANSLATE")) {
+			aot_translate(analysis, ram, argv[1], out);
+			fclose(out);
+		} else {
+			analysis_dump(analysis, ram, out);
+		}
+
+		free(built);
+		if (cache)
+			cache_close(cache);
+		return out ? 0 : -1;
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+
 	SDL_Window *window = SDL_CreateWindow("Chip-8 Emulator Project", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_W, WINDOW_H, 0);
-	Display_t display;
+	Display_t display = { .capture = NULL };
 	display.renderer = SDL_CreateRenderer(window, -1, 0);
 	SDL_RenderSetScale(display.renderer, WINDOW_SCALE, WINDOW_SCALE);
 	display_clear(&display);
@@ -655,12 +3412,36 @@ int main(int argc, char *argv[]) {
 	const uint8_t *keys = SDL_GetKeyboardState(NULL);
 
 	cpu.ram = ram;
+	cpu.decoded = cache ? cache->decoded : NULL;
 	cpu.display = &display;
 
-	srand(time(NULL));
+	cpu.seed = time(NULL);
+
+	if (getenv("CAPTURE")) {
+		display.capture = capture_open(getenv("CAPTURE"), getenv("CAPTURE_SCALE") ? atoi(getenv("CAPTURE_SCALE")) : 4);
+	}
+
+	if (getenv("DEBUG")) {
+		debugger.paused = true;
+		debugger_update_armed();
+	}
+
+	/** Run ahead RUNAHEAD frames and present that, hiding input lag */
+	unsigned long runahead = getenv("RUNAHEAD") ? strtoul(getenv("RUNAHEAD"), NULL, 10) : 0;
+	Snapshot_t *snapshot = runahead ? malloc(sizeof(Snapshot_t)) : NULL;
+	SDL_Renderer *renderer = display.renderer;
+	if (runahead)
+		display.renderer = NULL; /** Only present once a frame */
+
+	/** Telemetry sink and title bar overlay, refreshed every TELEMETRY_INTERVAL seconds */
+	const char *sink = getenv("TELEMETRY");
+	bool overlay = getenv("TELEMETRY_OVERLAY");
+	uint64_t interval = (getenv("TELEMETRY_INTERVAL") ? strtoull(getenv("TELEMETRY_INTERVAL"), NULL, 10) : 1) * 1000000000ULL;
+	uint64_t frame_start = clock_ns();
+	uint64_t interval_start = frame_start;
+	uint64_t interval_instructions = 0;
 
 	/** Tick-tock */
-	uint64_t cycles = 0;
 	while (true) {
 		SDL_Event e;
 
@@ -670,23 +3451,97 @@ int main(int argc, char *argv[]) {
 		}
 
 		cpu_poll_keystate(&cpu, keys);
-		cpu_execute(&cpu, ram_get_instruction(ram, cpu.pc));
 
-		if (cpu.flags.HALT) break;
+		if (debugger.armed && debugger_check(&cpu)) {
+			uint64_t paused = clock_ns();
+			if (!debugger_prompt(&cpu))
+				break;
+
+			/** Time at the prompt isn't frame time or late frames */
+			paused = clock_ns() - paused;
+			frame_start += paused;
+			interval_start += paused;
+		}
+
+		cpu_cycle(&cpu);
+
+		if (cpu.flags.HALT) {
+			if (cpu.pc <= RAM_SIZE - INSTRUCTION_LENGTH)
+				fprintf(stderr, "%s %04x at %03x! HALTING!\n", cpu.fault, cpu.fault_instruction, cpu.pc);
+			else
+				fprintf(stderr, "%s fetching at %03x! HALTING!\n", cpu.fault, cpu.pc);
+			break;
+		}
+
+		if (runahead && cpu.cycles % CYCLES_PER_FRAME == 0) {
+			/** Don't trip breakpoints in frames that never happened */
+			bool speculate = !debugger.armed;
+
+			if (speculate) {
+				snapshot_save(snapshot, &cpu);
+				cpu.flags.SPECULATIVE = 1;
+				for (uint64_t c = 0; c < runahead * CYCLES_PER_FRAME && !cpu.flags.HALT; c++)
+					cpu_cycle(&cpu);
+			}
+
+			display.renderer = renderer;
+			display_render(&display);
+			display.renderer = NULL;
+
+			if (speculate)
+				snapshot_restore(snapshot, &cpu);
+		}
 
-		SDL_Delay(2); /* ~ 520Hz */
-		if ((++cycles % 8 /* ~60 Hz */) == 0) {
-			cpu_timer_tick(&cpu);
+		if (cpu.cycles % CYCLES_PER_FRAME == 0) {
+			uint64_t now = clock_ns();
+			uint64_t elapsed = now - frame_start;
+			frame_start = now;
+
+			telemetry.frames++;
+			histogram_record(&telemetry.frame_time, elapsed);
+			if (elapsed > FRAME_NS * 3 / 2)
+				telemetry.late++;
+			if (elapsed >= FRAME_NS * 2)
+				telemetry.dropped += elapsed / FRAME_NS - 1;
+
+			telemetry.events = SDL_PeepEvents(NULL, 0, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+			if (telemetry.events > telemetry.max_events)
+				telemetry.max_events = telemetry.events;
+
+			if (now - interval_start >= interval) {
+				telemetry.ips = (telemetry.instructions - interval_instructions) * 1000000000ULL / (now - interval_start);
+				interval_instructions = telemetry.instructions;
+				interval_start = now;
+
+				if (overlay) {
+					char title[128];
+					snprintf(title, sizeof(title), "Chip-8 Emulator Project | %" PRIu64 " IPS | frame p99 %.1f ms | present p99 %.1f ms | %" PRIu64 " late",
+						telemetry.ips, histogram_percentile(&telemetry.frame_time, 99) / 1e6,
+						histogram_percentile(&telemetry.present_time, 99) / 1e6, telemetry.late);
+					SDL_SetWindowTitle(window, title);
+				}
+				if (sink)
+					telemetry_send(sink);
+			}
 		}
+
+		SDL_Delay(2); /* ~ 520Hz, timers at ~60 Hz */
 	}
 
 	/** Cleanup */
+	if (cache)
+		cache_close(cache);
+	if (display.capture)
+		capture_close(display.capture, cpu.cycles / CYCLES_PER_FRAME);
+	free(snapshot);
+	display.renderer = renderer;
 	SDL_DestroyRenderer(display.renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 
 	return 0;
 }
+#endif
 
 #define TEST_EQUALS(a,b) if (a == b) { printf("."); passed++; } else { printf("F("#a"[%04x] != "#b"[%04x])\n", a, b); failed++; }
 
@@ -699,7 +3554,7 @@ int test(int argc, char *argv[]) {
 	uint8_t _ram[RAM_SIZE] = { 0 };
 	RAM_t ram = _ram;
 
-	Display_t display;
+	Display_t display = { .renderer = NULL };
 	display_clear(&display);
 
 	/** Display clear */
@@ -733,7 +3588,6 @@ int test(int argc, char *argv[]) {
 
 	/**
 	 * Some display tests.
-	 * \todo We should really be testing for DXYN, too.
 	 */
 	bool unset = display_draw_row(&display, 0x80, 0, 0);
 	TEST_EQUALS((uint8_t)(display.p[0] & 0xff), 0x01)
@@ -748,7 +3602,9 @@ int test(int argc, char *argv[]) {
 	FILE *tmp = tmpfile();
 	/** Call function which sets V0 to 0x6 */
 	fwrite(STRING_LEN_COUNT(\x61\x00\x22\x04\x60\x06\x00\xee), tmp); fflush(tmp);
+	uint8_t after_rom = ram[ROM_OFFSET + 8];
 	fseek(tmp, 0, SEEK_SET); ram_load_file(ram, ROM_OFFSET, tmp);
+	TEST_EQUALS(ram[ROM_OFFSET + 8], after_rom);
 
 	cpu_reset(&cpu);
 	cpu.ram = ram;
@@ -872,6 +3728,559 @@ int test(int argc, char *argv[]) {
 	TEST_EQUALS(cpu.v[1], 11);
 	TEST_EQUALS(cpu.v[2], 0);
 
+	/**
+	 * DXYN Draw 8xN sprite at VX VY.
+	 */
+	cpu_reset(&cpu);
+	cpu.ram = ram;
+	cpu.display = &display;
+	display_clear(&display);
+	ram_write_byte(ram, 0x300, 0xc0);
+	ram_write_byte(ram, 0x301, 0x81);
+	cpu.i = 0x300;
+	cpu.v[0] = 4;
+	cpu.v[1] = 2;
+	cpu_execute(&cpu, 0xd012);
+	TEST_EQUALS((uint32_t)display.p[2], 0x30);
+	TEST_EQUALS((uint32_t)display.p[3], 0x810);
+	TEST_EQUALS(cpu.v[0xf], 0);
+	cpu.v[0] = 5;
+	cpu_execute(&cpu, 0xd011);
+	TEST_EQUALS((uint32_t)display.p[2], 0x50);
+	TEST_EQUALS(cpu.v[0xf], 1);
+	TEST_EQUALS(cpu.pc, 0x204);
+
+	/**
+	 * Timers tick once a frame.
+	 */
+	cpu_reset(&cpu);
+	cpu.ram = ram;
+	cpu.delay = 2;
+	for (int c = 0; c < CYCLES_PER_FRAME; c++)
+		cpu_cycle(&cpu);
+	TEST_EQUALS(cpu.delay, 1);
+	TEST_EQUALS((uint32_t)cpu.cycles, CYCLES_PER_FRAME);
+
+	/**
+	 * Snapshots roll back CPU, RAM and display.
+	 */
+	Snapshot_t snapshot;
+	cpu.v[3] = 0x33;
+	ram_write_byte(ram, 0x400, 0x44);
+	display.p[5] = 0x55;
+	snapshot_save(&snapshot, &cpu);
+	cpu.v[3] = 0;
+	cpu.delay = 0;
+	ram_write_byte(ram, 0x400, 0);
+	display.p[5] = 0;
+	cpu_cycle(&cpu);
+	snapshot_restore(&snapshot, &cpu);
+	TEST_EQUALS(cpu.v[3], 0x33);
+	TEST_EQUALS(cpu.delay, 1);
+	TEST_EQUALS((uint32_t)cpu.cycles, CYCLES_PER_FRAME);
+	TEST_EQUALS(ram_get_byte(ram, 0x400), 0x44);
+	TEST_EQUALS((uint32_t)display.p[5], 0x55);
+	TEST_EQUALS((cpu.ram == ram), true);
+
+	/**
+	 * Histograms.
+	 */
+	Histogram_t histogram = { .total = 0 };
+	histogram_record(&histogram, 5);
+	histogram_record(&histogram, 1000);
+	histogram_record(&histogram, 1000000);
+	TEST_EQUALS((uint32_t)histogram_percentile(&histogram, 0), 5);
+	TEST_EQUALS((uint32_t)histogram_percentile(&histogram, 50), 960);
+	TEST_EQUALS((uint32_t)histogram_percentile(&histogram, 99), 983040);
+	TEST_EQUALS((uint32_t)histogram.max, 1000000);
+	for (int bucket = HISTOGRAM_SUB_BUCKETS; bucket < HISTOGRAM_BUCKETS; bucket++) {
+		Histogram_t single = { .total = 0 };
+		histogram_record(&single, histogram_bucket_floor(bucket));
+		if (!single.counts[bucket]) {
+			TEST_EQUALS(bucket, -1);
+		}
+	}
+
+	/**
+	 * Captures coalesce duplicate frames and drop when full.
+	 */
+	Capture_t *capture = calloc(1, sizeof(Capture_t));
+	display.p[0] = 1;
+	capture_push(capture, display.p, 1);
+	capture_push(capture, display.p, 2);
+	TEST_EQUALS((uint32_t)atomic_load(&capture->head), 1);
+	for (int f = 0; f < CAPTURE_QUEUE; f++) {
+		display.p[0] = f + 2;
+		capture_push(capture, display.p, f + 3);
+	}
+	TEST_EQUALS((uint32_t)atomic_load(&capture->head), CAPTURE_QUEUE);
+	TEST_EQUALS((uint32_t)capture->dropped, 1);
+	TEST_EQUALS((uint32_t)capture->frames[1].frame, 3);
+	free(capture);
+
+	/**
+	 * ROMs that don't fit in RAM are refused.
+	 */
+	char rom_path[] = "/tmp/c8-test-XXXXXX";
+	int rom_fd = mkstemp(rom_path);
+	uint8_t rom_image[RAM_SIZE - ROM_OFFSET] = { 0 };
+	size_t rom_size = 0;
+	write(rom_fd, rom_image, sizeof(rom_image));
+	TEST_EQUALS((ram_read_rom(rom_path, rom_image, &rom_size) == NULL), true);
+	TEST_EQUALS((uint32_t)rom_size, RAM_SIZE - ROM_OFFSET);
+	write(rom_fd, rom_image, 1);
+	TEST_EQUALS(strcmp(ram_read_rom(rom_path, rom_image, &rom_size), "Too large"), 0);
+	close(rom_fd);
+	unlink(rom_path);
+	TEST_EQUALS(strcmp(ram_read_rom(rom_path, rom_image, &rom_size), "Can't open"), 0);
+
+	/**
+	 * Golden files are only recorded on request and must match in full.
+	 */
+	snprintf(rom_path, sizeof(rom_path), "/tmp/c8-test-XXXXXX");
+	rom_fd = mkstemp(rom_path);
+	write(rom_fd, "\x70\x01\x12\x00", 4);
+	close(rom_fd);
+	Regression_t golden_run = { .frames = 120, .checkpoint = 60 };
+	snprintf(golden_run.rom, sizeof(golden_run.rom), "%s", rom_path);
+	regression_run(&golden_run);
+	TEST_EQUALS((golden_run.error != NULL), true);
+	golden_run = (Regression_t){ .frames = 120, .checkpoint = 60, .update = true };
+	snprintf(golden_run.rom, sizeof(golden_run.rom), "%s", rom_path);
+	regression_run(&golden_run);
+	TEST_EQUALS(golden_run.recorded, true);
+	golden_run = (Regression_t){ .frames = 120, .checkpoint = 60 };
+	snprintf(golden_run.rom, sizeof(golden_run.rom), "%s", rom_path);
+	regression_run(&golden_run);
+	TEST_EQUALS((golden_run.error == NULL), true);
+	TEST_EQUALS(golden_run.mismatches, 0);
+	golden_run = (Regression_t){ .frames = 60, .checkpoint = 60 };
+	snprintf(golden_run.rom, sizeof(golden_run.rom), "%s", rom_path);
+	regression_run(&golden_run);
+	TEST_EQUALS(golden_run.mismatches, 1);
+	TEST_EQUALS((uint32_t)golden_run.first_mismatch, 120);
+	unlink(rom_path);
+	snprintf(golden_run.rom, sizeof(golden_run.rom), "%s.golden", rom_path);
+	unlink(golden_run.rom);
+
+	/**
+	 * The last captured frame lasts until the capture ends.
+	 */
+	char capture_path[] = "/tmp/c8-test-XXXXXX";
+	close(mkstemp(capture_path));
+	capture = capture_open(capture_path, 1);
+	display.p[0] = 1;
+	capture_push(capture, display.p, 0);
+	display.p[0] = 2;
+	capture_push(capture, display.p, 3);
+	capture_close(capture, 10);
+	FILE *captured = fopen(capture_path, "rb");
+	int captured_frames = 0;
+	char captured_line[DISPLAY_W];
+	fgets(captured_line, sizeof(captured_line), captured);
+	while (fread(captured_line, 1, 6, captured) == 6 && !memcmp(captured_line, "FRAME\n", 6)) {
+		captured_frames++;
+		fseek(captured, DISPLAY_W * DISPLAY_H * 3 / 2, SEEK_CUR);
+	}
+	fclose(captured);
+	TEST_EQUALS(captured_frames, 10);
+
+	/**
+	 * GIF frame delays are at least 2cs and add up to the capture length.
+	 */
+	char gif_path[] = "/tmp/c8-test-XXXXXX.gif";
+	close(mkstemps(gif_path, 4));
+	capture = capture_open(gif_path, 1);
+	for (int f = 0; f < 60; f++) {
+		display.p[0] = f + 1;
+		capture_push(capture, display.p, f);
+	}
+	capture_close(capture, 120);
+	captured = fopen(gif_path, "rb");
+	fseek(captured, 38, SEEK_SET);
+	int gif_delays = 0, gif_short = 0, block;
+	while ((block = fgetc(captured)) == 0x21) {
+		uint8_t control[7];
+		fread(control, 1, sizeof(control), captured);
+		gif_delays += control[3] | control[4] << 8;
+		gif_short += (control[3] | control[4] << 8) < 2;
+		fseek(captured, 11, SEEK_CUR);
+		for (int size; (size = fgetc(captured)) > 0;)
+			fseek(captured, size, SEEK_CUR);
+	}
+	fclose(captured);
+	TEST_EQUALS(block, 0x3b);
+	TEST_EQUALS(gif_delays, 200);
+	TEST_EQUALS(gif_short, 0);
+
+	/**
+	 * A static screen held past the 16-bit GIF delay is split, not wrapped.
+	 */
+	capture = capture_open(gif_path, 1);
+	capture_push(capture, display.p, 0);
+	capture_close(capture, 60000);
+	captured = fopen(gif_path, "rb");
+	fseek(captured, 38, SEEK_SET);
+	gif_delays = gif_short = 0;
+	while ((block = fgetc(captured)) == 0x21) {
+		uint8_t control[7];
+		fread(control, 1, sizeof(control), captured);
+		gif_delays += control[3] | control[4] << 8;
+		gif_short += (control[3] | control[4] << 8) < 2;
+		fseek(captured, 11, SEEK_CUR);
+		for (int size; (size = fgetc(captured)) > 0;)
+			fseek(captured, size, SEEK_CUR);
+	}
+	fclose(captured);
+	TEST_EQUALS(block, 0x3b);
+	TEST_EQUALS(gif_delays, 100000);
+	TEST_EQUALS(gif_short, 0);
+	unlink(capture_path);
+	unlink(gif_path);
+
+	/**
+	 * Guest faults halt instead of exiting.
+	 */
+	cpu_reset(&cpu);
+	cpu.ram = ram;
+	cpu.i = 0xffe;
+	cpu_execute(&cpu, 0xf355);
+	TEST_EQUALS(cpu.flags.HALT, 1);
+	TEST_EQUALS(strcmp(cpu.fault, "Segmentation fault"), 0);
+	TEST_EQUALS(cpu.pc, ROM_OFFSET);
+	cpu_reset(&cpu);
+	cpu.ram = ram;
+	cpu.pc = RAM_SIZE - 1;
+	cpu_cycle(&cpu);
+	TEST_EQUALS(cpu.flags.HALT, 1);
+	cpu_reset(&cpu);
+	cpu_execute(&cpu, 0x00ee);
+	TEST_EQUALS(strcmp(cpu.fault, "Stack underrun"), 0);
+	TEST_EQUALS(cpu.fault_instruction, 0x00ee);
+
+	/**
+	 * Fuzzing runs from a clean machine every time.
+	 */
+	uint8_t input[FUZZ_FRAMES * 2 + 4] = { 0 };
+	memcpy(input + FUZZ_FRAMES * 2, "\xaf\xff\xf1\x55", 4); /** I = FFF, write V0 and V1 */
+	TEST_EQUALS(strcmp(fuzz_one(input, sizeof(input)), "Segmentation fault"), 0);
+	memcpy(input + FUZZ_FRAMES * 2, "\x12\x00", 2); /** Loop forever */
+	TEST_EQUALS((fuzz_one(input, sizeof(input)) == NULL), true);
+	uint64_t fuzz_state = 1;
+	int fuzz_unknown = 0;
+	for (int n = 0; n < 1000; n++) {
+		char fuzz_mnemonic[32];
+		c8_instruction_t instruction = fuzz_instruction(&fuzz_state, 64);
+		cpu_disassemble(instruction, fuzz_mnemonic, sizeof(fuzz_mnemonic));
+		fuzz_unknown += !strncmp(fuzz_mnemonic, "DW", 2) || (instruction >> 12) == 0xb;
+	}
+	TEST_EQUALS(fuzz_unknown, 0);
+
+	/**
+	 * Static analysis.
+	 */
+	memset(ram, 0, RAM_SIZE);
+	memcpy(ram + ROM_OFFSET,
+		"\xa2\x10" /* 200: LD I, 210 */
+		"\x22\x0a" /* 202: CALL 20a */
+		"\x30\x00" /* 204: SE V0, 00 */
+		"\x12\x00" /* 206: JP 200 */
+		"\xb3\x00" /* 208: JP V0, 300 */
+		"\xd0\x02" /* 20a: DRW V0, V0, 2 */
+		"\x00\xee" /* 20c: RET */
+		"\x00\x00"
+		"\xf0\x90", 18);
+	Analysis_t *analysis = malloc(sizeof(Analysis_t));
+	analysis_build(analysis, ram, 18);
+	TEST_EQUALS(analysis->block_count, 5);
+	TEST_EQUALS(analysis->blocks[0].end, 0x204);
+	TEST_EQUALS(analysis->blocks[0].flags, BLOCK_CALL);
+	TEST_EQUALS(analysis->blocks[1].start, 0x204);
+	TEST_EQUALS(analysis->blocks[1].count, 2);
+	TEST_EQUALS(analysis->blocks[2].start, 0x206);
+	TEST_EQUALS(analysis->blocks[3].start, 0x208);
+	TEST_EQUALS(analysis->blocks[3].flags, BLOCK_DYNAMIC);
+	TEST_EQUALS(analysis->blocks[4].start, 0x20a);
+	TEST_EQUALS(analysis->blocks[4].flags, BLOCK_RETURN);
+	TEST_EQUALS((analysis_find_block(analysis, 0x20d) == &analysis->blocks[4]), true);
+	TEST_EQUALS((analysis_find_block(analysis, 0x20e) == NULL), true);
+	TEST_EQUALS(bitmap_test(analysis->code, 0x20d), true);
+	TEST_EQUALS(bitmap_test(analysis->code, 0x20e), false);
+	TEST_EQUALS(bitmap_test(analysis->dynamic, 0x3ff), true);
+	TEST_EQUALS(bitmap_test(analysis->data, 0x210), false); /** I unknown in the called block */
+	memcpy(ram + 0x208, "\x12\x08", 2); /** Overwrite 208 */
+	memcpy(ram + 0x202, "\xf1\x55", 2);
+	memcpy(ram + 0x200, "\xa2\x08", 2);
+	analysis_build(analysis, ram, 18);
+	TEST_EQUALS(bitmap_test(analysis->dynamic, 0x209), true);
+	TEST_EQUALS((analysis_find_block(analysis, 0x208)->flags & BLOCK_DYNAMIC), BLOCK_DYNAMIC);
+	memset(ram, 0, RAM_SIZE);
+	memcpy(ram + ROM_OFFSET, "\x1f\xfe", 2); /** Dead end at ffe */
+	analysis_build(analysis, ram, 2);
+	TEST_EQUALS(analysis->block_count, 2);
+	TEST_EQUALS(analysis->blocks[1].flags, BLOCK_HALT);
+	memcpy(ram + 0xffe, "\x1f\xfe", 2); /** Jump to self at ffe */
+	analysis_build(analysis, ram, 2);
+	TEST_EQUALS(analysis->blocks[1].start, 0xffe);
+	TEST_EQUALS(analysis->blocks[1].end, RAM_SIZE);
+	memset(ram, 0, RAM_SIZE);
+	memcpy(ram + ROM_OFFSET,
+		"\x30\x00" /* 200: SE V0, 00 */
+		"\x12\x05" /* 202: JP 205 */
+		"\x60\x12" /* 204: LD V0, 12, 205: JP 200 */
+		"\x00\xe0" /* 206: CLS */
+		"\x12\x08", 10); /* 208: JP 208 */
+	analysis_build(analysis, ram, 10);
+	TEST_EQUALS(analysis->block_count, 6);
+	TEST_EQUALS(analysis_find_block(analysis, 0x205)->start, 0x205);
+	TEST_EQUALS(analysis_find_block(analysis, 0x206)->start, 0x206);
+	TEST_EQUALS(analysis_find_block(analysis, 0x204)->start, 0x204);
+	for (int b = 1; b < analysis->block_count; b++) {
+		if (analysis->blocks[b].start < analysis->blocks[b - 1].end - 1) {
+			TEST_EQUALS(analysis->blocks[b].start, -1);
+		}
+	}
+
+	/**
+	 * Ahead-of-time translation specializes everything in this ROM.
+	 * `TRANSLATE=file TEST=1` writes it out to build with AOT_ROM.
+	 */
+	const uint8_t aot_test[] = {
+		0x60, 0x05, /* 200: LD V0, 05 */
+		0x61, 0x07, /* 202: LD V1, 07 */
+		0x22, 0x16, /* 204: CALL 216 */
+		0x50, 0x10, /* 206: SE V0, V1 */
+		0x90, 0x10, /* 208: SNE V0, V1 */
+		0x00, 0xe0, /* 20a: CLS */
+		0xf2, 0x07, /* 20c: LD V2, DT */
+		0x32, 0x00, /* 20e: SE V2, 00 */
+		0x12, 0x0c, /* 210: JP 20c */
+		0x32, 0x01, /* 212: SE V2, 01 */
+		0x12, 0x04, /* 214: JP 204 */
+		0x80, 0x14, /* 216: ADD V0, V1 */
+		0x8f, 0x04, /* 218: ADD VF, V0 */
+		0x80, 0x15, /* 21a: SUB V0, V1 */
+		0x83, 0x06, /* 21c: SHR V3, V0 */
+		0x84, 0x17, /* 21e: SUBN V4, V1 */
+		0x85, 0x4e, /* 220: SHL V5, V4 */
+		0x86, 0x50, /* 222: LD V6, V5 */
+		0x86, 0x01, /* 224: OR V6, V0 */
+		0x86, 0x42, /* 226: AND V6, V4 */
+		0x86, 0x13, /* 228: XOR V6, V1 */
+		0xa3, 0x00, /* 22a: LD I, 300 */
+		0xf6, 0x1e, /* 22c: ADD I, V6 */
+		0x71, 0x03, /* 22e: ADD V1, 03 */
+		0x67, 0x02, /* 230: LD V7, 02 */
+		0xf7, 0x15, /* 232: LD DT, V7 */
+		0xf7, 0x18, /* 234: LD ST, V7 */
+		0x00, 0xee, /* 236: RET */
+	};
+	memset(ram, 0, RAM_SIZE);
+	memcpy(ram + ROM_OFFSET, aot_test, sizeof(aot_test));
+	analysis_build(analysis, ram, sizeof(aot_test));
+	char *translated = NULL;
+	size_t translated_size = 0;
+	FILE *translation = open_memstream(&translated, &translated_size);
+	aot_translate(analysis, ram, "test", translation);
+	fclose(translation);
+	TEST_EQUALS((strstr(translated, "case 0x236:") != NULL), true);
+	TEST_EQUALS((strstr(translated, "cpu_execute") == NULL), true);
+	if (getenv("TRANSLATE") && (translation = fopen(getenv("TRANSLATE"), "w"))) {
+		fwrite(translated, 1, translated_size, translation);
+		fclose(translation);
+	}
+	free(translated);
+	free(analysis);
+
+#ifdef AOT_ROM
+	/**
+	 * The translated ROM runs exactly like the interpreter.
+	 */
+	{
+		uint8_t aot_ram[RAM_SIZE] = { 0 }, interpreter_ram[RAM_SIZE] = { 0 };
+		Display_t aot_display = { .renderer = NULL, .capture = NULL }, interpreter_display = aot_display;
+		CPU_t aot_cpu, interpreter_cpu;
+		memcpy(aot_ram + ROM_OFFSET, aot_rom, aot_rom_size);
+		ram_load_digit_sprites(aot_ram, BUILTIN_SPRITES_OFFSET);
+		memcpy(interpreter_ram, aot_ram, RAM_SIZE);
+		display_clear(&aot_display);
+		display_clear(&interpreter_display);
+		cpu_reset(&aot_cpu);
+		cpu_reset(&interpreter_cpu);
+		aot_cpu.ram = aot_ram;
+		interpreter_cpu.ram = interpreter_ram;
+		aot_cpu.display = &aot_display;
+		interpreter_cpu.display = &interpreter_display;
+		aot_cpu.flags.MUTE = interpreter_cpu.flags.MUTE = 1;
+
+		/** Lockstep, the interpreter copy never takes the translation */
+		int diverged = -1, translated_cycles = 0;
+		for (int cycle = 0; cycle < 600 * CYCLES_PER_FRAME && diverged < 0; cycle++) {
+			aot_cpu.input = interpreter_cpu.input = 1 << (cycle / (30 * CYCLES_PER_FRAME) % 16);
+
+			if (aot_cpu.pc > RAM_SIZE - INSTRUCTION_LENGTH)
+				cpu_fault(&aot_cpu, "Segmentation fault", 0);
+			else if (aot_execute(&aot_cpu))
+				translated_cycles++;
+			else
+				cpu_execute(&aot_cpu, ram_get_instruction(aot_cpu.ram, aot_cpu.pc));
+
+			if (interpreter_cpu.pc > RAM_SIZE - INSTRUCTION_LENGTH)
+				cpu_fault(&interpreter_cpu, "Segmentation fault", 0);
+			else
+				cpu_execute(&interpreter_cpu, ram_get_instruction(interpreter_cpu.ram, interpreter_cpu.pc));
+
+			if ((++aot_cpu.cycles % CYCLES_PER_FRAME) == 0)
+				cpu_timer_tick(&aot_cpu);
+			if ((++interpreter_cpu.cycles % CYCLES_PER_FRAME) == 0)
+				cpu_timer_tick(&interpreter_cpu);
+
+			if (cpu_hash(&aot_cpu) != cpu_hash(&interpreter_cpu) || aot_cpu.flags.HALT != interpreter_cpu.flags.HALT
+					|| memcmp(aot_cpu.stack, interpreter_cpu.stack, sizeof(aot_cpu.stack)) || memcmp(aot_ram, interpreter_ram, RAM_SIZE))
+				diverged = cycle;
+		}
+		TEST_EQUALS(diverged, -1);
+		TEST_EQUALS((translated_cycles > 0), true);
+	}
+#endif
+
+	/**
+	 * The cache builds, reuses and replaces stale entries.
+	 */
+	char directory[] = "/tmp/c8-test-XXXXXX";
+	if (mkdtemp(directory)) {
+		const uint8_t image[] = { 0x60, 0x01, 0x12, 0x00 };
+		const Cache_t *cache = cache_open(directory, image, sizeof(image));
+		TEST_EQUALS((cache != NULL), true);
+		TEST_EQUALS(cache->decoded[0x202], 0x1200);
+		TEST_EQUALS(cache->analysis.block_count, 1);
+
+		/** Fetches go through the decoded instructions */
+		cpu_reset(&cpu);
+		cpu.ram = ram;
+		cpu.decoded = cache->decoded;
+		memcpy(ram + ROM_OFFSET, "\x60\x09\x12\x02", 4);
+		cpu_cycle(&cpu);
+		TEST_EQUALS(cpu.v[0], 0x01);
+		cpu_cycle(&cpu);
+		TEST_EQUALS(cpu.pc, 0x200);
+		cpu.decoded = NULL;
+
+		char path[PATH_MAX];
+		cache_path(path, directory, cache->hash);
+		cache_close(cache);
+
+		cache = cache_map(path);
+		TEST_EQUALS(cache_valid(cache, fnv1a(FNV_OFFSET, image, sizeof(image)), image, sizeof(image)), true);
+		cache_close(cache);
+
+		/** Stale version */
+		FILE *entry = fopen(path, "r+b");
+		fseek(entry, offsetof(Cache_t, version), SEEK_SET);
+		fputc(0xff, entry);
+		fclose(entry);
+		cache = cache_map(path);
+		TEST_EQUALS((cache->version == CACHE_VERSION), false);
+		cache_close(cache);
+		cache = cache_open(directory, image, sizeof(image));
+		TEST_EQUALS(cache->version, CACHE_VERSION);
+		cache_close(cache);
+		unlink(path);
+
+		/** A BCD draw loop is decoded, even with I unknown in the subroutine */
+		const uint8_t writes[] = {
+			0x63, 0x00, /* 200: LD V3, 00 */
+			0xa3, 0x00, /* 202: LD I, 300 */
+			0x22, 0x10, /* 204: CALL 210 */
+			0x73, 0x01, /* 206: ADD V3, 01 */
+			0x12, 0x02, /* 208: JP 202 */
+			0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			0xf3, 0x33, /* 210: LD B, V3 */
+			0xf2, 0x65, /* 212: LD V2, [I] */
+			0xf2, 0x29, /* 214: LD F, V2 */
+			0xd0, 0x15, /* 216: DRW V0, V1, 5 */
+			0x00, 0xee, /* 218: RET */
+		};
+		cache = cache_open(directory, writes, sizeof(writes));
+		TEST_EQUALS(cache->analysis.unknown_writes, true);
+		TEST_EQUALS(cache->decoded[0x200], 0x6300);
+		TEST_EQUALS(cache->decoded[0x210], 0xf333);
+		memset(ram, 0, RAM_SIZE);
+		memcpy(ram + ROM_OFFSET, writes, sizeof(writes));
+		cpu_reset(&cpu);
+		cpu.ram = ram;
+		cpu.display = &display;
+		cpu.decoded = cache->decoded;
+		for (int c = 0; c < 100; c++)
+			cpu_cycle(&cpu);
+		TEST_EQUALS((cpu.decoded == cache->decoded), true);
+		TEST_EQUALS(cpu.v[3], 0x0b);
+
+		/** Until the code gets overwritten */
+		cpu.i = 0x217;
+		cpu_execute(&cpu, 0xf055);
+		TEST_EQUALS((cpu.decoded == NULL), true);
+		cache_path(path, directory, cache->hash);
+		cache_close(cache);
+		unlink(path);
+		rmdir(directory);
+	}
+
+	/**
+	 * Control flow successors.
+	 */
+	c8_address_t successors[2];
+	TEST_EQUALS(cpu_successors(0x1234, 0x200, successors), 1);
+	TEST_EQUALS(successors[0], 0x234);
+	TEST_EQUALS(cpu_successors(0x2456, 0x200, successors), 2);
+	TEST_EQUALS(successors[0], 0x456);
+	TEST_EQUALS(successors[1], 0x202);
+	TEST_EQUALS(cpu_successors(0x3001, 0x200, successors), 2);
+	TEST_EQUALS(successors[1], 0x204);
+	TEST_EQUALS(cpu_successors(0x00ee, 0x200, successors), 0);
+	TEST_EQUALS(cpu_successors(0x6001, 0x200, successors), 1);
+	TEST_EQUALS(successors[0], 0x202);
+
+	/**
+	 * Disassembly.
+	 */
+	char mnemonic[32];
+	cpu_disassemble(0x6a9f, mnemonic, sizeof(mnemonic));
+	TEST_EQUALS(strcmp(mnemonic, "LD VA, 9f"), 0);
+	cpu_disassemble(0xd125, mnemonic, sizeof(mnemonic));
+	TEST_EQUALS(strcmp(mnemonic, "DRW V1, V2, 5"), 0);
+	cpu_disassemble(0x5121, mnemonic, sizeof(mnemonic));
+	TEST_EQUALS(strcmp(mnemonic, "DW 5121"), 0);
+
+	/**
+	 * Watchpoints.
+	 */
+	bitmap_set(debugger.watch_write, 0x300);
+	debugger_update_armed();
+	TEST_EQUALS(debugger.armed, true);
+	ram_write_byte(ram, 0x301, 0);
+	TEST_EQUALS(debugger.paused, false);
+	ram_write_byte(ram, 0x300, 0);
+	TEST_EQUALS(debugger.paused, true);
+	bitmap_clear(debugger.watch_write, 0x300);
+	debugger.paused = false;
+	debugger_update_armed();
+	TEST_EQUALS(debugger.armed, false);
+
+	/** Fetches fire read watchpoints even with decoded instructions */
+	static c8_instruction_t watched_decoded[RAM_SIZE] = { [ROM_OFFSET] = 0x6001 };
+	memcpy(ram + ROM_OFFSET, "\x60\x01", 2);
+	cpu_reset(&cpu);
+	cpu.ram = ram;
+	cpu.decoded = watched_decoded;
+	bitmap_set(debugger.watch_read, ROM_OFFSET);
+	debugger_update_armed();
+	cpu_cycle(&cpu);
+	TEST_EQUALS(debugger.paused, true);
+	bitmap_clear(debugger.watch_read, ROM_OFFSET);
+	debugger.paused = false;
+	debugger_update_armed();
+
 	printf("\n%d tests: %d passed, %d failed\n", passed + failed, passed, failed);
 
 	fclose(tmp);